@@ -0,0 +1,177 @@
+#pragma once
+
+#include "config.h"
+#include "log.h"
+#include "stored_value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+/*
+WiscKey式的key/value分离: flush时不小于Options::blob_value_threshold字节的value追加写入blob文件,
+SST中只保存key和BlobIndex, compaction只复制BlobIndex而不复制value.
+- blob文件只追加, 当前文件达到blob_file_size字节后封存, 之后写入新文件
+- value被覆盖或删除后, blob文件中的旧value成为垃圾; GC检查封存文件中每条记录是否仍被LSM引用(记录中保存了key),
+  垃圾比例不低于blob_gc_garbage_ratio时把存活的value重新追加并更新LSM中的BlobIndex, 全部更新之后再删除整个文件
+*/
+
+/**
+ * @brief blob文件的写入和GC统计, 单位为value的字节数
+ */
+struct BlobStats {
+    std::size_t blobs_written = 0;
+    std::size_t bytes_written = 0;
+    std::size_t gc_runs = 0;
+    // GC删除的文件中垃圾value的字节数
+    std::size_t gc_bytes_reclaimed = 0;
+    // GC重新追加的存活value的字节数
+    std::size_t gc_bytes_rewritten = 0;
+};
+
+template <typename K, typename V>
+class BlobStore {
+    struct BlobFile {
+        // (key, value), key用于GC时判断value是否仍被引用
+        std::vector<std::pair<K, V>> records;
+        std::size_t bytes = 0;
+    };
+
+    // 按文件号(创建顺序)排列, 最后一个是正在写入的文件
+    std::map<std::uint64_t, BlobFile> files;
+    std::uint64_t next_file_number = 1;
+    // GC轮转检查的位置: 上次检查的文件号
+    std::uint64_t gc_cursor = 0;
+    // 上次GC之后新封存的文件数
+    std::size_t newly_sealed = 0;
+    // collect_garbage()选出, 等待搬迁的value写回后删除的文件
+    std::vector<std::uint64_t> collected;
+    // 当前文件达到该字节数后封存
+    std::size_t file_size;
+    // 垃圾比例不低于该值时GC才重写文件
+    double gc_garbage_ratio;
+    BlobStats stats;
+
+  public:
+    explicit BlobStore(
+        std::size_t file_size = CONFIG::BLOB_FILE_SIZE, double gc_garbage_ratio = CONFIG::BLOB_GC_GARBAGE_RATIO
+    )
+        : file_size(file_size), gc_garbage_ratio(gc_garbage_ratio) {}
+
+    void set_options(std::size_t file_size, double gc_garbage_ratio) {
+        this->file_size = file_size;
+        this->gc_garbage_ratio = gc_garbage_ratio;
+    }
+
+    BlobIndex add(const K &key, const V &value) {
+        if (files.empty() || files.rbegin()->second.bytes >= file_size) {
+            if (!files.empty()) {
+                ++newly_sealed;
+            }
+            files.emplace(next_file_number++, BlobFile{});
+        }
+        auto &[file_number, file] = *files.rbegin();
+        BlobIndex index{file_number, file.records.size(), entry_size(value)};
+        file.records.emplace_back(key, value);
+        file.bytes += index.size;
+        ++stats.blobs_written;
+        stats.bytes_written += index.size;
+        return index;
+    }
+
+    const V &get(const BlobIndex &index) const {
+        auto it = files.find(index.file_number);
+        ASSERT_FATAL(it != files.end() && index.offset < it->second.records.size());
+        return it->second.records[index.offset].second;
+    }
+
+    /**
+     * @return index所在的文件还没有被GC删除; GC只删除不再被引用的value, 引用已删除文件的版本都已被更新的版本遮挡
+     */
+    bool contains(const BlobIndex &index) const { return files.count(index.file_number) > 0; }
+
+    /**
+     * @brief 返回并清零上次调用以来新封存的文件数
+     */
+    std::size_t take_newly_sealed() { return std::exchange(newly_sealed, 0); }
+
+    /**
+     * @brief 从上次检查的位置开始轮转检查最多max_files个封存的文件, 把垃圾比例不低于gc_garbage_ratio的文件中
+     *        存活的value重新追加到新文件; 被GC的文件保留到delete_collected_files(), 在此之前旧的BlobIndex仍然可以读取
+     * @param is_live is_live(key, index)为true表示该value仍被LSM引用
+     * @param relocated 追加每个搬迁的value的(key, 新的BlobIndex), 由调用者在检查完成后写回LSM
+     * @return 被GC的文件数
+     */
+    template <typename IsLive>
+    std::size_t collect_garbage(IsLive &&is_live, std::size_t max_files, std::vector<std::pair<K, BlobIndex>> &relocated) {
+        ASSERT_FATAL(collected.empty());
+        // 不包括正在写入的文件; GC重新追加的value可能产生新文件, 先确定要检查的文件
+        std::vector<std::uint64_t> candidates;
+        if (!files.empty()) {
+            auto active = std::prev(files.end());
+            auto first = files.upper_bound(gc_cursor);
+            for (auto it = first; candidates.size() < max_files && it != files.end() && it != active; ++it) {
+                candidates.push_back(it->first);
+            }
+            for (auto it = files.begin(); candidates.size() < max_files && it != first && it != active; ++it) {
+                candidates.push_back(it->first);
+            }
+        }
+
+        for (std::uint64_t file_number : candidates) {
+            gc_cursor = file_number;
+            ++stats.gc_runs;
+            // add()只插入新的文件, map中已有元素的引用保持有效
+            const BlobFile &file = files.at(file_number);
+            std::vector<std::uint64_t> live;
+            std::size_t live_bytes = 0;
+            for (std::uint64_t offset = 0; offset < file.records.size(); ++offset) {
+                const auto &[key, value] = file.records[offset];
+                if (is_live(key, BlobIndex{file_number, offset, entry_size(value)})) {
+                    live.push_back(offset);
+                    live_bytes += entry_size(value);
+                }
+            }
+            std::size_t garbage_bytes = file.bytes - live_bytes;
+            if (file.bytes == 0 || static_cast<double>(garbage_bytes) < gc_garbage_ratio * file.bytes) {
+                continue;
+            }
+            LOG_INFO("blob GC: file {} has {}/{} garbage bytes", file_number, garbage_bytes, file.bytes);
+            for (std::uint64_t offset : live) {
+                const auto &[key, value] = file.records[offset];
+                relocated.emplace_back(key, add(key, value));
+            }
+            collected.push_back(file_number);
+            stats.gc_bytes_reclaimed += garbage_bytes;
+            stats.gc_bytes_rewritten += live_bytes;
+        }
+        return collected.size();
+    }
+
+    /**
+     * @brief 搬迁的value都写回LSM之后, 删除collect_garbage()选出的文件
+     * @return 删除的文件数
+     */
+    std::size_t delete_collected_files() {
+        for (std::uint64_t file_number : collected) {
+            files.erase(file_number);
+        }
+        return std::exchange(collected, {}).size();
+    }
+
+    std::size_t get_file_count() const { return files.size(); }
+
+    // 所有blob文件(包括垃圾)的字节数
+    std::size_t get_total_bytes() const {
+        std::size_t bytes = 0;
+        for (const auto &[file_number, file] : files) {
+            bytes += file.bytes;
+        }
+        return bytes;
+    }
+
+    const BlobStats &get_stats() const { return stats; }
+};
@@ -0,0 +1,449 @@
+#pragma once
+
+#include "blob.h"
+#include "compaction_filter.h"
+#include "config.h"
+#include "log.h"
+#include "mem_table.h"
+#include "merge_operator.h"
+#include "options.h"
+#include "policy.h"
+#include "sst.h"
+#include "storage.h"
+#include "stored_value.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+column family: 一个LSM中逻辑上独立的keyspace. 每个column family有自己的MemTable/Immutable MemTable, LevelStorage,
+Options(compaction策略, MemTable/SST的大小等), BlobStore, merge operator和compaction filter;
+同一个LSM的所有column family共享锁, 后台compaction线程, WriteController/RateLimiter和MemTable的总大小限制,
+一次WriteBatch可以原子地写入多个column family.
+ColumnFamily只在持有LSM的锁时使用, Policy见policy.h
+*/
+
+/**
+ * @brief LSM::create_column_family返回的句柄, 0是默认的column family
+ */
+struct ColumnFamilyHandle {
+    std::size_t id = 0;
+};
+
+template <typename K, typename V>
+struct ColumnFamilyOptions : Options {
+    // 设置后每个SST会额外构建prefix filter, 以支持prefix_scan跳过无关的SST
+    PrefixExtractor<K> prefix_extractor;
+    // merge()使用的可结合的merge operator
+    MergeOperator<V> merge_operator;
+    // compaction输出的每个key/value经过该filter
+    CompactionFilter<K, V> compaction_filter;
+};
+
+template <typename K, typename V, typename Policy = DefaultPolicy>
+class ColumnFamily {
+    using Stored = StoredValue<V>;
+    using Table = typename Policy::template MemTable<K, Stored>;
+
+    std::string name;
+    ColumnFamilyOptions<K, V> options;
+    std::unique_ptr<Table> mem_table;
+    // 最新的在最后
+    std::list<std::unique_ptr<Table>> immutable_memtables;
+    LevelStorage<K, Stored, Policy> levels;
+    BlobStore<K, V> blob_store;
+    // 写入过带TTL的entry后, compaction才需要检查过期时间
+    bool ttl_enabled = false;
+    // 为false时flush只把SST加入L0(后台compaction)
+    bool compact_on_flush;
+    // 每次flush之后调用, LSM据此更新WriteController并唤醒后台compaction
+    std::function<void()> flush_listener;
+
+    ColumnFamily(const ColumnFamily &) = delete;
+    ColumnFamily &operator=(const ColumnFamily &) = delete;
+
+    /**
+     * @brief 把不小于blob_value_threshold字节的value追加到blob文件, 返回只保存BlobIndex的MemTable
+     */
+    std::unique_ptr<Table> separate_values(const Table &memtable) {
+        auto separated = std::make_unique<Table>(options.mem_entries);
+        for (const auto &[key, value] : memtable.get_table()) {
+            if (value.has_value() && !value->is_blob() && !value->is_operand() &&
+                entry_size(value->get_value()) >= options.blob_value_threshold) {
+                separated->set(key, Stored(blob_store.add(key, value->get_value()), value->get_expire_at()));
+            } else {
+                separated->set(key, value);
+            }
+        }
+        return separated;
+    }
+
+    /**
+     * @brief 解析查找到的最新版本; 没有更旧的版本可以合并的merge operand本身就是value
+     */
+    std::optional<V> resolve(const std::optional<Stored> &value) const {
+        if (!value.has_value()) {
+            return std::nullopt;
+        }
+        if (value->is_blob()) {
+            return blob_store.get(value->get_blob_index());
+        }
+        if (value->is_operand()) {
+            return value->get_operand();
+        }
+        return value->get_value();
+    }
+
+    /**
+     * @brief 把较新的merge operand newer合并到较旧的版本older上(VersionMerger)
+     * @details 已过期的older视为不存在; 引用已被GC删除的blob文件的older也视为不存在, 这时合并结果同样已被遮挡;
+     *          合并结果沿用older的过期时间
+     */
+    Stored merge_versions(const std::optional<Stored> &older, const Stored &newer) const {
+        if (!older.has_value() || older->is_expired(now_millis()) ||
+            (older->is_blob() && !blob_store.contains(older->get_blob_index()))) {
+            return Stored(newer.get_operand());
+        }
+        if (older->is_operand()) {
+            return Stored(MergeOperand<V>{options.merge_operator(older->get_operand(), newer.get_operand())});
+        }
+        return Stored(options.merge_operator(*resolve(older), newer.get_operand()), older->get_expire_at());
+    }
+
+    // 没有merge operator时为空, 不会产生merge operand
+    VersionMerger<Stored> version_merger() const {
+        if (!options.merge_operator) {
+            return nullptr;
+        }
+        return [this](const std::optional<Stored> &older, const Stored &newer) { return merge_versions(older, newer); };
+    }
+
+    /**
+     * @brief 把用户的CompactionFilter包装为处理StoredValue的filter: 先删除已过期的entry,
+     *        分离的value先从blob文件读出, merge operand不经过filter
+     */
+    CompactionFilter<K, Stored> stored_compaction_filter() const {
+        if (!options.compaction_filter && !ttl_enabled) {
+            return nullptr;
+        }
+        return [this](const K &key, const Stored &value, Stored &new_value) {
+            if (value.is_operand()) {
+                return FilterDecision::Keep;
+            }
+            if (value.is_expired(now_millis())) {
+                return FilterDecision::Remove;
+            }
+            // 引用已被GC删除的blob文件的版本已被更新的版本遮挡, 之后的compaction会丢弃它
+            if (!options.compaction_filter || (value.is_blob() && !blob_store.contains(value.get_blob_index()))) {
+                return FilterDecision::Keep;
+            }
+            const V &plain = value.is_blob() ? blob_store.get(value.get_blob_index()) : value.get_value();
+            V changed{};
+            FilterDecision decision = options.compaction_filter(key, plain, changed);
+            if (decision == FilterDecision::ChangeValue) {
+                new_value = Stored(std::move(changed), value.get_expire_at());
+            }
+            return decision;
+        };
+    }
+
+    // 不检查过期时间
+    std::optional<Stored> find_latest(const K &key) const {
+        // 找到merge operand时继续查找更旧的版本
+        std::optional<Stored> result;
+        auto merge_found = [&](std::optional<Stored> found) {
+            result = result.has_value() ? merge_versions(found, *result) : std::move(*found);
+            return !is_merge_operand(result);
+        };
+
+        // 1. MemTable
+        auto found = mem_table->get(key);
+        if (found.has_value()) {
+            LOG_DEBUG("key={}, found in MemTable", key);
+            if (merge_found(std::move(found))) {
+                return result;
+            }
+        }
+
+        // 2. Immutable MemTable(较新的在后面)
+        for (auto it = immutable_memtables.rbegin(); it != immutable_memtables.rend(); ++it) {
+            found = (*it)->get(key);
+            if (found.has_value()) {
+                LOG_DEBUG("key={}, found in ImmutableMemTable", key);
+                if (merge_found(std::move(found))) {
+                    return result;
+                }
+            }
+        }
+
+        // 3. SST(从L0->Lmax)
+        levels.get(key, result);
+        return result;
+    }
+
+    /**
+     * @brief 查找key的第一个不是merge operand的版本(更新的merge operand合并到它上面), 不做合并, 不检查过期时间
+     */
+    std::optional<Stored> find_base(const K &key) const {
+        auto found = mem_table->get(key);
+        if (found.has_value() && !found->is_operand()) {
+            return found;
+        }
+        for (auto it = immutable_memtables.rbegin(); it != immutable_memtables.rend(); ++it) {
+            found = (*it)->get(key);
+            if (found.has_value() && !found->is_operand()) {
+                return found;
+            }
+        }
+        std::optional<Stored> base;
+        levels.get_base(key, base);
+        return base;
+    }
+
+    /**
+     * @brief 查找key的最新版本(value或BlobIndex), 已过期时返回nullopt
+     */
+    std::optional<Stored> find(const K &key) const {
+        auto result = find_latest(key);
+        if (result.has_value() && result->is_expired(now_millis())) {
+            LOG_DEBUG("key={}, expired", key);
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    /**
+     * @brief 从新到旧收集MemTable/Immutable MemTable/各层SST中从start开始满足in_range的entry, 去掉删除标记
+     */
+    template <typename InRange, typename Skip>
+    std::vector<std::pair<K, V>> collect(const K &start, InRange &&in_range, Skip &&skip) const {
+        std::map<K, std::optional<Stored>> merged;
+        VersionMerger<Stored> merger = version_merger();
+        auto scan_memtable = [&](const Table &table) {
+            for (auto it = table.get_table().lower_bound(start); it != table.get_table().end() && in_range(it->first); ++it) {
+                add_older_version(merged, it->first, it->second, merger);
+            }
+        };
+        scan_memtable(*mem_table);
+        for (auto it = immutable_memtables.rbegin(); it != immutable_memtables.rend(); ++it) {
+            scan_memtable(**it);
+        }
+        levels.scan(start, in_range, skip, merged);
+
+        std::vector<std::pair<K, V>> result;
+        std::int64_t now = now_millis();
+        for (auto &[key, value] : merged) {
+            if (value.has_value() && !value->is_expired(now)) {
+                result.emplace_back(key, *resolve(value));
+            }
+        }
+        return result;
+    }
+
+  public:
+    ColumnFamily(std::string name, ColumnFamilyOptions<K, V> options, bool compact_on_flush)
+        : name(std::move(name)),
+          options(apply_policy<Policy>(std::move(options))),
+          mem_table(std::make_unique<Table>(this->options.mem_entries, this->options.mem_bytes)),
+          levels(this->options, this->options.prefix_extractor),
+          blob_store(this->options.blob_file_size, this->options.blob_gc_garbage_ratio),
+          compact_on_flush(compact_on_flush) {
+        levels.set_version_merger(version_merger());
+        levels.set_compaction_filter(stored_compaction_filter());
+        LOG_INFO("column family {}: {}", this->name, levels);
+    }
+
+    void set_flush_listener(std::function<void()> listener) { flush_listener = std::move(listener); }
+
+    bool is_memtable_full() const { return mem_table->is_full(); }
+
+    // MemTable和Immutable MemTable中的entry数
+    std::size_t get_memtable_entries() const {
+        std::size_t entries = mem_table->size();
+        for (const auto &memtable : immutable_memtables) {
+            entries += memtable->size();
+        }
+        return entries;
+    }
+
+    // MemTable和Immutable MemTable的字节数
+    std::size_t get_memtable_bytes() const {
+        std::size_t bytes = mem_table->get_memory_usage();
+        for (const auto &memtable : immutable_memtables) {
+            bytes += memtable->get_memory_usage();
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief MemTable->Immutable MemTable, Immutable MemTable超过max_memtables时把最旧的刷入L0
+     * @return 刷入L0的entry数, 没有flush时为0
+     */
+    std::size_t flush_memtable() {
+        LOG_INFO("{}: MemTable is full, MemTable->Immutable MemTable", name);
+        // MemTable full, 则MemTable->Immutable MemTable, 然后新建一个MemTable;
+        immutable_memtables.push_back(std::move(mem_table));
+        mem_table = std::make_unique<Table>(options.mem_entries, options.mem_bytes);
+
+        // 如果Immutable MemTable也full, 则刷入L0(L0不保证不重叠)
+        if (immutable_memtables.size() > options.max_memtables) {
+            LOG_INFO("Too many ImmutableMemTables, flushing oldest to SST");
+            return flush_oldest_immutable();
+        }
+        return 0;
+    }
+
+    /**
+     * @brief 把最旧的Immutable MemTable(没有时为MemTable)转换为SST并添加到L0
+     * @return 刷入L0的entry数, 没有数据时为0
+     */
+    std::size_t flush_oldest_immutable() {
+        if (immutable_memtables.empty()) {
+            if (mem_table->empty()) {
+                return 0;
+            }
+            immutable_memtables.push_back(std::move(mem_table));
+            mem_table = std::make_unique<Table>(options.mem_entries, options.mem_bytes);
+        }
+        std::unique_ptr<Table> oldest_memtable = std::move(immutable_memtables.front());
+        immutable_memtables.pop_front();
+
+        ASSERT_FATAL(!oldest_memtable->empty());
+        if (options.blob_value_threshold > 0) {
+            oldest_memtable = separate_values(*oldest_memtable);
+        }
+        SST<K, Stored> new_sst(
+            *oldest_memtable, options.sst_entries, levels[0].get_filter_type(), options.prefix_extractor, options
+        );
+        std::size_t flushed = new_sst.size();
+
+        levels.add_sst_to_l0(std::move(new_sst), compact_on_flush);
+        LOG_INFO("{}: added new SST to L0, now has {} SSTs", name, levels[0].get_sst_count());
+        if (flush_listener) {
+            flush_listener();
+        }
+        return flushed;
+    }
+
+    void set(const K &key, const V &value, std::int64_t expire_at = NEVER_EXPIRE) {
+        if (expire_at != NEVER_EXPIRE && !ttl_enabled) {
+            ttl_enabled = true;
+            levels.set_compaction_filter(stored_compaction_filter());
+        }
+        mem_table->set(key, Stored(value, expire_at));
+    }
+
+    /**
+     * @brief 只读取MemTable: MemTable中已有该key时直接合并, 否则写入merge operand
+     */
+    void merge(const K &key, const V &operand) {
+        ASSERT_FATAL(options.merge_operator);
+        Stored stored(MergeOperand<V>{operand});
+        auto existing = mem_table->get(key);
+        if (existing.has_value()) {
+            stored = merge_versions(existing, stored);
+        }
+        mem_table->set(key, stored);
+    }
+
+    std::optional<V> get(const K &key) const {
+        auto result = find(key);
+        if (!result.has_value()) {
+            LOG_DEBUG("key={}, not found", key);
+        }
+        return resolve(result);
+    }
+
+    std::vector<std::pair<K, V>> scan(const K &start, const K &end) const {
+        return collect(
+            start, [&](const K &key) { return key < end; },
+            [&](const SST<K, Stored> &sst) { return !sst.may_contain_range(start, end); }
+        );
+    }
+
+    std::vector<std::pair<K, V>> prefix_scan(const K &prefix) const {
+        ASSERT_FATAL(options.prefix_extractor);
+        return collect(
+            prefix, [&](const K &key) { return options.prefix_extractor(key) == prefix; },
+            [&](const SST<K, Stored> &sst) { return !sst.may_contain_prefix(prefix); }
+        );
+    }
+
+    /**
+     * @brief blob GC的检查阶段: 检查最多max_files个封存的blob文件, 期间不修改LSM
+     * @return 需要写回MemTable的entry: 搬迁的value的新BlobIndex, 以及叠加在被GC的blob上的merge operand合并后的value;
+     *         全部write_back()之后调用delete_collected_blob_files()
+     */
+    std::vector<std::pair<K, Stored>> collect_blob_garbage(std::size_t max_files) {
+        std::vector<std::pair<K, Stored>> rewrites;
+        std::vector<std::pair<K, BlobIndex>> relocated;
+        blob_store.collect_garbage(
+            [&](const K &key, const BlobIndex &index) {
+                auto current = find(key);
+                if (!current.has_value()) {
+                    return false;
+                }
+                if (current->is_blob()) {
+                    return current->get_blob_index() == index;
+                }
+                // 最新版本是叠加在该blob上的merge operand: 写回合并的结果之后该blob不再被引用
+                auto base = find_base(key);
+                if (base.has_value() && base->is_blob() && base->get_blob_index() == index &&
+                    !base->is_expired(now_millis())) {
+                    rewrites.emplace_back(key, *current);
+                }
+                return false;
+            },
+            max_files, relocated
+        );
+        for (const auto &[key, index] : relocated) {
+            rewrites.emplace_back(key, Stored(index, find_latest(key)->get_expire_at()));
+        }
+        return rewrites;
+    }
+
+    /**
+     * @brief 把blob GC需要写回的entry写入MemTable, 调用前由LSM保证MemTable没有满
+     */
+    void write_back(const K &key, const Stored &value) { mem_table->set(key, value); }
+
+    /**
+     * @brief 写回完成后删除被GC的blob文件; 写回时可能flush并触发compaction, 这些文件要到全部写回之后才能删除
+     * @return 删除的blob文件数
+     */
+    std::size_t delete_collected_blob_files() { return blob_store.delete_collected_files(); }
+
+    /**
+     * @return blob_auto_gc开启且上次调用以来有新封存的blob文件; 每封存一个blob文件检查一个旧文件, GC的开销随写入分摊
+     */
+    bool take_sealed_blob_files() { return options.blob_auto_gc && blob_store.take_newly_sealed() > 0; }
+
+    /**
+     * @brief 运行时修改配置(compact_type和num_levels不变), 之后创建的MemTable/SST和之后的compaction生效
+     * @details 同步compaction时立即完成按新的配置需要的compaction
+     */
+    void set_options(const Options &new_options) {
+        static_cast<Options &>(options) = apply_policy<Policy>(new_options);
+        mem_table->set_limits(options.mem_entries, options.mem_bytes);
+        blob_store.set_options(options.blob_file_size, options.blob_gc_garbage_ratio);
+        levels.set_options(options);
+        if (compact_on_flush) {
+            while (levels.compact_once()) {
+            }
+        }
+    }
+
+    const Options &get_options() const { return options; }
+    const std::string &get_name() const { return name; }
+    const LevelStorage<K, Stored, Policy> &get_levels() const { return levels; }
+    LevelStorage<K, Stored, Policy> &get_levels() { return levels; }
+    const BlobStore<K, V> &get_blob_store() const { return blob_store; }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "fmt/format.h"
+#include "stored_value.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+/*
+compaction filter: compaction(SST::merge/merge_split)输出的每个key/value都会经过用户的回调, 可以保留, 删除或修改;
+过期数据和需要改写的旧格式value在正常的compaction中顺带处理, 不需要额外的scan和删除.
+- 删除: 合并入最后一层时直接丢弃, 否则输出删除标记, 使更旧的层中的版本不可见
+- 删除标记和merge operand不经过filter
+- 设置了Options::subcompactions时会被多个线程同时调用
+*/
+
+enum class FilterDecision {
+    Keep,
+    Remove,
+    // 用new_value替换value
+    ChangeValue
+};
+
+/**
+ * @brief 对compaction输出的每个key/value调用, 返回ChangeValue时new_value为新的value
+ */
+template <typename K, typename V>
+using CompactionFilter = std::function<FilterDecision(const K &key, const V &value, V &new_value)>;
+
+/**
+ * @brief 带写入时间的value, 配合make_ttl_filter使用
+ */
+template <typename V>
+struct Timestamped {
+    V value;
+    // 写入时间, system_clock的毫秒数
+    std::int64_t timestamp = 0;
+
+    static Timestamped now(V value) { return {std::move(value), now_millis()}; }
+};
+
+/**
+ * @brief 内置的TTL filter: 删除写入时间早于ttl之前的value
+ */
+template <typename K, typename V>
+CompactionFilter<K, Timestamped<V>> make_ttl_filter(std::chrono::milliseconds ttl) {
+    return [ttl](const K &, const Timestamped<V> &value, Timestamped<V> &) {
+        return value.timestamp + ttl.count() <= now_millis() ? FilterDecision::Remove : FilterDecision::Keep;
+    };
+}
+
+template <typename V>
+struct fmt::formatter<Timestamped<V>> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const Timestamped<V> &value, FormatContext &ctx) const {
+        return fmt::format_to(ctx.out(), "{}@{}", value.value, value.timestamp);
+    }
+};
@@ -1,27 +1,51 @@
 #pragma once
 
+#include <chrono>
 #include <string>
+#include "filter.h"
 #include "log.h"
+#include "search.h"
+#include <vector>
 
 /*
 - Leveling(层内有序、key不重叠)
-  - 一层一个文件(SST)
+  - 一层是一个有序run, 由多个固定大小、key不重叠的文件(SST)组成
   - 文件有序
-  - 层之间的每个文件大小倍率为T
-  - L-1层满了，就整个合并入L层（L_{i-1}+L_{i}->L_i)）
+  - 层之间的总大小倍率为T
+  - L-1层满了，就选出其中一个文件, 只与L层中key范围重叠的文件合并
 - Tiering(可以重叠)
   - 每层T个文件
   - 文件内部有序，文件之间key可以重叠
   - 层之间的每个文件大小倍率为T
   - L-1层满了，则T个文件整个合并作为L层的一个文件
+- LazyLeveling(Dostoevsky/Fluid LSM, 按层选择策略)
+  - 除最后一层外都是Tiering: 每层最多K个run, 满了整层合并为一个run进入下一层, 写入代价低
+  - 最后一层最多Z个run: Z=1时是Leveling的有序run(点查和空间放大都低), Z>1时满了整层合并
+- Universal(RocksDB的universal compaction, 按run大小选择)
+  - 新数据在L0中以多个按时间排列的run存在, 最旧的一个run是最后一层的有序run, 中间层不使用
+  - L0的run数超过UNIVERSAL_MAX_RUNS时依次尝试:
+    1. 空间放大: L0的总大小超过最后一层的UNIVERSAL_MAX_SPACE_AMP_PERCENT%, 把L0全部合并入最后一层;
+       UNIVERSAL_INCREMENTAL_FILES>0时这些run先转为draining, 之后每次flush只合并最后一层中相邻几个文件的key范围
+       与draining run中落在该范围内的片段(按大小相近合并入最后一层时同样如此)
+    2. 大小相近: 从新到旧累加run的大小, 下一个run不超过累加值的(100+UNIVERSAL_SIZE_RATIO)%就一起合并
+    3. 以上都不满足时合并最新的几个run, 使run数回到UNIVERSAL_MAX_RUNS
+- Fifo(只追加、从不更新的时序数据)
+  - 所有SST按到达顺序留在L0, 从不合并, 写放大为1
+  - L0的总entry数超过FIFO_MAX_ENTRIES或最旧的SST存在超过FIFO_TTL时, 整个删除最旧的SST
 */
 
 enum class CompactType {
-    // 一个Level只有一个SST, 不同Level的SST之间大小倍率为NUM_LEVEL_MULTI
+    // 一个Level是一个有序run(多个key不重叠的SST), 不同Level之间总大小倍率为NUM_LEVEL_MULTI
     Leveling,
     // 一个Level有T个SST, 不同Level的SST之间大小倍率为NUM_LEVEL_MULTI=T
     // 当L被填满时(该Level出现了T个component), 该层的T个component会合并为一个新的component(所以是T倍), 进入L+1
-    Tiering
+    Tiering,
+    // 上层Tiering(每层NUM_UPPER_LEVEL_RUNS个run), 最后一层NUM_LAST_LEVEL_RUNS个run(1即Leveling)
+    LazyLeveling,
+    // L0中的run按大小相近合并, 空间放大超过阈值时合并入最后一层的有序run
+    Universal,
+    // 只有L0, 不合并, 按总大小或存在时间删除最旧的SST
+    Fifo
 };
 
 struct CONFIG {
@@ -31,7 +55,11 @@ struct CONFIG {
     static inline std::size_t NUM_SST_ENTRY = 4;
     // MemTable的最大数量(一些immutable_memtables和一个mem_table, 达到后阻塞前台进行写入)
     static inline std::size_t NUM_MAX_MEM_TABLE = 2;
-    // LO最大大小(达到后阻塞MemTable进行flush)
+    // MemTable的字节数上限(key/value的字节数加节点开销的估算), 与NUM_MEM_ENTRY先达到者为准; 0为只按entry数限制
+    static inline std::size_t MEM_TABLE_BYTES = 0;
+    // 进程内共享的WriteBufferManager::global()的MemTable(包括Immutable MemTable)总字节数上限; 0为不限制
+    static inline std::size_t WRITE_BUFFER_SIZE = 0;
+    // LO最大大小(达到后触发L0的compaction; 后台compaction时写入的减速/停止由L0_SLOWDOWN_SSTS/L0_STOP_SSTS控制)
     static inline std::size_t NUM_MAX_L0_SST = 3;
     // L1最大大小达到后阻塞L0往L1进行Compact)
     // static inline std::size_t NUM_MAX_L1_SST = 5;
@@ -39,8 +67,77 @@ struct CONFIG {
     static inline std::size_t NUM_LEVEL_MULTI = 5;
     // 最大层数
     static inline std::size_t NUM_LEVELS = 7;
+    // Leveling下L1及以后每个SST文件的最大entry数
+    static inline std::size_t NUM_FILE_ENTRY = 64;
+    // Leveling下根据最后一层的实际大小动态推导各层容量(而不是从L1开始固定乘NUM_LEVEL_MULTI)
+    static inline bool dynamic_level_entries = false;
 
     static inline CompactType compact_type = CompactType::Tiering;
+    // LazyLeveling: 除最后一层外每层最多的run数(tiering factor K)
+    static inline std::size_t NUM_UPPER_LEVEL_RUNS = 5;
+    // LazyLeveling: 最后一层最多的run数(Z), 1表示最后一层是一个有序run, 只合并重叠的文件
+    static inline std::size_t NUM_LAST_LEVEL_RUNS = 1;
+    // Universal: L0中最多的run数, 超过后触发compaction; run按大小相近合并时大小近似成倍增长, 需要比NUM_MAX_L0_SST多
+    static inline std::size_t UNIVERSAL_MAX_RUNS = 12;
+    // Universal: 大小相近的判断比例(百分比)
+    static inline std::size_t UNIVERSAL_SIZE_RATIO = 1;
+    // Universal: 一次按大小相近合并的最少run数, 不小于2
+    static inline std::size_t UNIVERSAL_MIN_MERGE_WIDTH = 2;
+    // Universal: L0总大小超过最后一层大小的该百分比时触发合并入最后一层
+    static inline std::size_t UNIVERSAL_MAX_SPACE_AMP_PERCENT = 200;
+    // Universal: 合并入最后一层时每次flush之后只合并的最后一层文件数(按key从小到大推进), 0表示一次合并整个最后一层
+    static inline std::size_t UNIVERSAL_INCREMENTAL_FILES = 0;
+    // 一次compaction的输入按key范围拆分给多少个线程并行归并, 1表示不拆分
+    static inline std::size_t NUM_SUBCOMPACTIONS = 1;
+    // 输入的entry数达到该值才拆分, 小的compaction不值得创建线程
+    static inline std::size_t SUBCOMPACTION_MIN_ENTRIES = 16384;
+    // flush只把SST加入L0, compaction由后台线程执行; 写入由WriteController减速/停止
+    static inline bool background_compaction = false;
+    // L0的SST数达到后开始减速写入
+    static inline std::size_t L0_SLOWDOWN_SSTS = 8;
+    // L0的SST数达到后停止写入
+    static inline std::size_t L0_STOP_SSTS = 16;
+    // compaction债务(还需要被compaction重写的entry数)达到后开始减速写入
+    static inline std::size_t SOFT_PENDING_COMPACTION_ENTRIES = 1 << 16;
+    // compaction债务达到后停止写入
+    static inline std::size_t HARD_PENDING_COMPACTION_ENTRIES = 1 << 18;
+    // 减速时每次写入最多等待的时间
+    static inline std::chrono::microseconds MAX_WRITE_DELAY{1000};
+    // flush和compaction每秒最多写入的entry数, 0表示不限制
+    static inline std::size_t RATE_LIMIT_ENTRIES_PER_SEC = 0;
+    // 令牌最多积累的时间(允许的突发量)
+    static inline std::chrono::milliseconds RATE_LIMIT_REFILL_PERIOD{100};
+    // 根据compaction债务自动提高限速(后台compaction时)
+    static inline bool RATE_LIMIT_AUTO_TUNE = false;
+    // 自动调整时最多为RATE_LIMIT_ENTRIES_PER_SEC的倍数
+    static inline std::size_t RATE_LIMIT_MAX_MULTIPLIER = 4;
+    // 不小于该字节数的value在flush时分离到blob文件, SST中只保存BlobIndex; 0表示不分离
+    static inline std::size_t BLOB_VALUE_THRESHOLD = 0;
+    // 一个blob文件达到该字节数后封存, 之后写入新文件
+    static inline std::size_t BLOB_FILE_SIZE = 1 << 20;
+    // blob文件中垃圾的比例不低于该值时GC才重写该文件
+    static inline double BLOB_GC_GARBAGE_RATIO = 0.5;
+    // 每封存一个blob文件, 自动对一个封存的文件进行GC检查
+    static inline bool blob_auto_gc = true;
+    // Fifo: L0最多保留的entry数, 0表示不限制
+    static inline std::size_t FIFO_MAX_ENTRIES = 0;
+    // Fifo: SST最长的存在时间, 0表示不限制
+    static inline std::chrono::milliseconds FIFO_TTL{0};
+
+    // SST内key的查找布局, 在SST创建时构建
+    static inline SearchLayout sst_search_layout = SearchLayout::Binary;
+    // SearchLayout::Learned的误差上界(越小模型段数越多)
+    static inline std::size_t LEARNED_INDEX_EPSILON = 16;
+    // SST的索引和filter按多少个key分区, 0表示不分区(整个SST一个索引/filter块)
+    static inline std::size_t SST_PARTITION_ENTRY = 4096;
+    // Bloom filter每个key占用的位数, 0表示不构建filter
+    static inline std::size_t BLOOM_BITS_PER_KEY = 10;
+    // SST的filter类型, level_filter_types中没有指定的层使用该类型
+    static inline FilterType filter_type = FilterType::Bloom;
+    // 按层指定filter类型(下标为层号), 超出的层使用filter_type; 例如{Bloom, Bloom, Ribbon}只让L2使用Ribbon
+    static inline std::vector<FilterType> level_filter_types = {};
+    // 数值key的SST范围filter每个key占用的位数, 0表示不构建(只用SST的key范围判断)
+    static inline std::size_t RANGE_FILTER_BITS_PER_KEY = 0;
 
     template <typename T>
     inline static void init_config(T &config, std::string_view config_name) {
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+/*
+SST的filter类型:
+- Bloom: 每个key占Options::bloom_bits_per_key位
+- Xor: 静态的xor filter(8位指纹), 约9.84位/key, 假阳性率约0.39%; 同样假阳性率的Bloom filter约需11.5位/key,
+  只节省约15%的内存
+- Ribbon: 静态的Standard Ribbon filter(8位指纹), 约8.3位/key, 假阳性率与Xor相同, 比同样假阳性率的Bloom节省约30%,
+  构建比Xor慢, 查询需要计算8次奇偶性
+Xor和Ribbon只能一次性构建, 正好适合创建后不可变的SST; 不到几百个key时固定的余量占比较大, 不如Bloom紧凑
+*/
+enum class FilterType {
+    Bloom,
+    Xor,
+    Ribbon
+};
+
+/**
+ * @brief key的64位hash, 在std::hash的基础上再做一次splitmix64混合(std::hash对整数通常是恒等映射)
+ */
+template <typename K>
+std::uint64_t key_hash(const K &key) {
+    std::uint64_t x = static_cast<std::uint64_t>(std::hash<K>{}(key));
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Bloom filter, SST创建时构建一次, 之后只读
+ * @details 使用double hashing: 第i个探测位置为 h1 + i * h2
+ */
+class BloomFilter {
+    std::vector<std::uint64_t> bits;
+    std::size_t num_bits = 0;
+    std::size_t num_probes = 0;
+
+  public:
+    BloomFilter() = default;
+
+    BloomFilter(const std::vector<std::uint64_t> &hashes, std::size_t bits_per_key) {
+        // 至少64位, 避免极小的SST假阳性过高
+        num_bits = std::max<std::size_t>(hashes.size() * bits_per_key, 64);
+        bits.assign((num_bits + 63) / 64, 0);
+        num_bits = bits.size() * 64;
+        // 最优探测次数 k = ln2 * bits_per_key
+        num_probes = std::clamp<std::size_t>(static_cast<std::size_t>(bits_per_key * 0.69), 1, 30);
+        for (std::uint64_t hash : hashes) {
+            std::uint64_t h1 = hash;
+            std::uint64_t h2 = (hash >> 32) | 1;
+            for (std::size_t i = 0; i < num_probes; ++i) {
+                std::uint64_t bit = (h1 + i * h2) % num_bits;
+                bits[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+    }
+
+    bool empty() const { return bits.empty(); }
+
+    bool may_contain(std::uint64_t hash) const {
+        std::uint64_t h1 = hash;
+        std::uint64_t h2 = (hash >> 32) | 1;
+        for (std::size_t i = 0; i < num_probes; ++i) {
+            std::uint64_t bit = (h1 + i * h2) % num_bits;
+            if ((bits[bit / 64] & (1ULL << (bit % 64))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::size_t memory_usage() const { return bits.capacity() * sizeof(std::uint64_t); }
+};
+
+/**
+ * @brief 8位指纹的xor filter, 构建后不可修改
+ * @details 每个key映射到三个不同块中的槽位, 满足 fp(key) == F[h0] ^ F[h1] ^ F[h2];
+ *          构建时通过peeling(不断摘除只被一个key占用的槽位)确定赋值顺序, 失败则换seed重试
+ */
+class XorFilter {
+    std::vector<std::uint8_t> fingerprints;
+    std::uint64_t seed = 0;
+    std::uint32_t block_length = 0;
+
+    static std::uint64_t mix(std::uint64_t hash, std::uint64_t seed) {
+        std::uint64_t h = hash + seed * 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+        h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+    }
+
+    static std::uint8_t fingerprint(std::uint64_t h) { return static_cast<std::uint8_t>(h ^ (h >> 32)); }
+
+    std::uint32_t slot(std::uint64_t h, int i) const {
+        std::uint64_t r = i == 0 ? h : (h << (21 * i)) | (h >> (64 - 21 * i));
+        // 把32位hash均匀映射到[0, block_length)
+        return static_cast<std::uint32_t>((static_cast<std::uint32_t>(r) * static_cast<std::uint64_t>(block_length)) >> 32) +
+               i * block_length;
+    }
+
+  public:
+    XorFilter() = default;
+
+    explicit XorFilter(std::vector<std::uint64_t> hashes) {
+        // 重复的hash永远无法peel, 去重后不影响正确性
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+        std::size_t capacity = 32 + static_cast<std::size_t>(1.23 * hashes.size());
+        block_length = static_cast<std::uint32_t>(capacity / 3);
+        capacity = block_length * 3;
+        fingerprints.assign(capacity, 0);
+
+        std::vector<std::uint64_t> xor_mask(capacity);
+        std::vector<std::uint32_t> count(capacity);
+        std::vector<std::uint32_t> queue;
+        // (key的hash, 该key被摘除时所在的槽位)
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> stack;
+        stack.reserve(hashes.size());
+        for (seed = 1;; ++seed) {
+            std::fill(xor_mask.begin(), xor_mask.end(), 0);
+            std::fill(count.begin(), count.end(), 0);
+            for (std::uint64_t hash : hashes) {
+                std::uint64_t h = mix(hash, seed);
+                for (int i = 0; i < 3; ++i) {
+                    std::uint32_t s = slot(h, i);
+                    xor_mask[s] ^= h;
+                    ++count[s];
+                }
+            }
+            queue.clear();
+            for (std::uint32_t s = 0; s < capacity; ++s) {
+                if (count[s] == 1) {
+                    queue.push_back(s);
+                }
+            }
+            stack.clear();
+            while (!queue.empty()) {
+                std::uint32_t s = queue.back();
+                queue.pop_back();
+                if (count[s] != 1) {
+                    continue;
+                }
+                std::uint64_t h = xor_mask[s];
+                stack.emplace_back(h, s);
+                for (int i = 0; i < 3; ++i) {
+                    std::uint32_t t = slot(h, i);
+                    xor_mask[t] ^= h;
+                    if (--count[t] == 1) {
+                        queue.push_back(t);
+                    }
+                }
+            }
+            if (stack.size() == hashes.size()) {
+                break;
+            }
+        }
+        // 逆序赋值, 保证每个key赋值时它的槽位还没有被其他key使用
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+            auto [h, s] = *it;
+            fingerprints[s] = fingerprint(h) ^ fingerprints[slot(h, 0)] ^ fingerprints[slot(h, 1)] ^ fingerprints[slot(h, 2)];
+        }
+    }
+
+    bool empty() const { return fingerprints.empty(); }
+
+    bool may_contain(std::uint64_t hash) const {
+        std::uint64_t h = mix(hash, seed);
+        return fingerprint(h) == (fingerprints[slot(h, 0)] ^ fingerprints[slot(h, 1)] ^ fingerprints[slot(h, 2)]);
+    }
+
+    std::size_t memory_usage() const { return fingerprints.capacity() * sizeof(std::uint8_t); }
+};
+
+/**
+ * @brief 8位结果的Standard Ribbon filter(Dillinger & Walzer), 构建后不可修改
+ * @details 每个key对应从start开始的一个128位系数行c和8位指纹, 构建时对带状矩阵做Gauss消元并回代,
+ *          得到每个槽位8位的解S, 满足 fp(key) == XOR{S[start + i] : c的第i位为1};
+ *          槽位数只比key数多约3%(加上128个槽位的余量), 假阳性率与8位指纹的xor filter相同(约0.39%), 约8.3位/key.
+ *          解按64个槽位一块, 每块8个字(每位指纹一个)交错存储, 查询时每位指纹是两个字与c按位与后的奇偶性
+ */
+class RibbonFilter {
+    using Coefficient = unsigned __int128;
+    static constexpr std::size_t width = 128;
+    static constexpr std::size_t result_bits = 8;
+
+    // 第(block * result_bits + bit)个字的第i位是槽位block * 64 + i的解的第bit位
+    std::vector<std::uint64_t> solution;
+    std::uint64_t seed = 0;
+    std::size_t num_starts = 0;
+
+    static std::uint64_t mix(std::uint64_t hash, std::uint64_t seed) {
+        std::uint64_t h = hash + seed * 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+        h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+    }
+
+    std::size_t start(std::uint64_t h) const { return static_cast<std::size_t>(((h >> 32) * num_starts) >> 32); }
+
+    // 最低位总是1, 消元时可以用它确定主元所在的行
+    static Coefficient coefficient(std::uint64_t h) {
+        std::uint64_t lo = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ULL;
+        std::uint64_t hi = (lo ^ (lo >> 32)) * 0x94d049bb133111ebULL;
+        return (static_cast<Coefficient>(hi) << 64) | lo | 1;
+    }
+
+    static std::uint8_t fingerprint(std::uint64_t h) { return static_cast<std::uint8_t>(h); }
+
+    static int trailing_zeros(Coefficient c) {
+        auto lo = static_cast<std::uint64_t>(c);
+        return lo != 0 ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(static_cast<std::uint64_t>(c >> 64));
+    }
+
+    // 第bit位指纹的解从槽位block * 64 + offset开始的64位
+    std::uint64_t window(std::size_t block, std::size_t offset, std::size_t bit) const {
+        std::uint64_t bits = solution[block * result_bits + bit] >> offset;
+        return offset == 0 ? bits : bits | solution[(block + 1) * result_bits + bit] << (64 - offset);
+    }
+
+    /**
+     * @brief 把所有key的行消元为以各自主元开头的带状上三角矩阵
+     * @return 出现矛盾的方程(系数消为0而指纹不为0)时返回false, 需要换seed重试
+     */
+    bool band(const std::vector<std::uint64_t> &hashes, std::vector<Coefficient> &rows, std::vector<std::uint8_t> &results) {
+        std::fill(rows.begin(), rows.end(), 0);
+        std::fill(results.begin(), results.end(), 0);
+        for (std::uint64_t hash : hashes) {
+            std::uint64_t h = mix(hash, seed);
+            std::size_t s = start(h);
+            Coefficient c = coefficient(h);
+            std::uint8_t r = fingerprint(h);
+            while (rows[s] != 0) {
+                c ^= rows[s];
+                r ^= results[s];
+                if (c == 0) {
+                    if (r != 0) {
+                        return false;
+                    }
+                    break;
+                }
+                int shift = trailing_zeros(c);
+                c >>= shift;
+                s += shift;
+            }
+            if (c != 0) {
+                rows[s] = c;
+                results[s] = r;
+            }
+        }
+        return true;
+    }
+
+  public:
+    RibbonFilter() = default;
+
+    explicit RibbonFilter(std::vector<std::uint64_t> hashes) {
+        // 重复的hash是相同的方程, 去重后不影响正确性
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+        // 槽位数取64的倍数, 每次start都有完整的width个槽位
+        std::size_t slots = (hashes.size() + hashes.size() / 32 + width / 2 + 63) / 64 * 64;
+        std::vector<Coefficient> rows;
+        std::vector<std::uint8_t> results;
+        for (seed = 1;; ++seed) {
+            // 连续失败时多留一些槽位, 保证构建很快结束
+            if (seed % 4 == 0) {
+                slots += std::max<std::size_t>(hashes.size() / 64 / 64 * 64, 64);
+            }
+            slots = std::max(slots, width);
+            num_starts = slots - width + 1;
+            rows.resize(slots);
+            results.resize(slots);
+            if (band(hashes, rows, results)) {
+                break;
+            }
+        }
+
+        // 从后往前回代: 槽位i的解由result和它之后width - 1个槽位的解确定, 空行的解取0
+        std::vector<std::uint8_t> values(slots);
+        for (std::size_t i = slots; i-- > 0;) {
+            std::uint8_t value = results[i];
+            for (Coefficient c = rows[i] >> 1; c != 0; c &= c - 1) {
+                value ^= values[i + 1 + trailing_zeros(c)];
+            }
+            values[i] = value;
+        }
+        solution.assign(slots / 64 * result_bits, 0);
+        for (std::size_t i = 0; i < slots; ++i) {
+            for (std::size_t bit = 0; bit < result_bits; ++bit) {
+                solution[i / 64 * result_bits + bit] |= static_cast<std::uint64_t>((values[i] >> bit) & 1) << (i % 64);
+            }
+        }
+    }
+
+    bool empty() const { return solution.empty(); }
+
+    bool may_contain(std::uint64_t hash) const {
+        std::uint64_t h = mix(hash, seed);
+        std::size_t s = start(h);
+        Coefficient c = coefficient(h);
+        auto lo = static_cast<std::uint64_t>(c);
+        auto hi = static_cast<std::uint64_t>(c >> 64);
+        std::uint8_t value = 0;
+        for (std::size_t bit = 0; bit < result_bits; ++bit) {
+            std::uint64_t parity = __builtin_popcountll(lo & window(s / 64, s % 64, bit)) +
+                                   __builtin_popcountll(hi & window(s / 64 + 1, s % 64, bit));
+            value |= static_cast<std::uint8_t>((parity & 1) << bit);
+        }
+        return value == fingerprint(h);
+    }
+
+    std::size_t memory_usage() const { return solution.capacity() * sizeof(std::uint64_t); }
+};
+
+/**
+ * @brief SST的filter, 根据FilterType构建Bloom, Xor或Ribbon
+ */
+class Filter {
+    std::variant<BloomFilter, XorFilter, RibbonFilter> filter;
+
+  public:
+    Filter(FilterType type, const std::vector<std::uint64_t> &hashes, std::size_t bits_per_key) {
+        switch (type) {
+            case FilterType::Xor:
+                filter = XorFilter(hashes);
+                break;
+            case FilterType::Ribbon:
+                filter = RibbonFilter(hashes);
+                break;
+            case FilterType::Bloom:
+            default:
+                filter = BloomFilter(hashes, bits_per_key);
+                break;
+        }
+    }
+
+    FilterType type() const {
+        switch (filter.index()) {
+            case 1:
+                return FilterType::Xor;
+            case 2:
+                return FilterType::Ribbon;
+            default:
+                return FilterType::Bloom;
+        }
+    }
+
+    bool may_contain(std::uint64_t hash) const {
+        return std::visit([hash](const auto &f) { return f.may_contain(hash); }, filter);
+    }
+
+    std::size_t memory_usage() const {
+        return std::visit([](const auto &f) { return f.memory_usage(); }, filter);
+    }
+};
+
+/**
+ * @brief 数值key的范围filter, 回答"[start, end)中可能有key吗"
+ * @details 把[min_key, max_key]等分为 bits_per_key * n 个桶, 每个桶一位表示桶内是否有key;
+ *          查询时检查与区间相交的桶中是否有置位. 没有假阴性, 假阳性只来自区间两端与有key的桶部分相交
+ */
+template <typename K>
+class RangeFilter {
+    static_assert(std::is_arithmetic_v<K>, "range filter only supports arithmetic keys");
+
+    K min_key{};
+    K max_key{};
+    double bucket_width = 1;
+    std::size_t num_buckets = 0;
+    std::vector<std::uint64_t> bits;
+
+    // 单调不减, 保证key在[start, end)中时bucket(start) <= bucket(key) <= bucket(end)
+    std::size_t bucket(const K &key) const {
+        double offset = (static_cast<double>(key) - static_cast<double>(min_key)) / bucket_width;
+        return std::min(static_cast<std::size_t>(std::max(offset, 0.0)), num_buckets - 1);
+    }
+
+  public:
+    RangeFilter() = default;
+
+    /**
+     * @param keys 有序的key
+     */
+    RangeFilter(const std::vector<K> &keys, std::size_t bits_per_key) {
+        if (keys.empty()) {
+            return;
+        }
+        min_key = keys.front();
+        max_key = keys.back();
+        num_buckets = std::max<std::size_t>(keys.size() * bits_per_key, 1);
+        double span = static_cast<double>(max_key) - static_cast<double>(min_key);
+        bucket_width = span > 0 ? span / static_cast<double>(num_buckets) : 1;
+        bits.assign((num_buckets + 63) / 64, 0);
+        for (const K &key : keys) {
+            std::size_t b = bucket(key);
+            bits[b / 64] |= 1ULL << (b % 64);
+        }
+    }
+
+    bool empty() const { return bits.empty(); }
+
+    bool may_contain_range(const K &start, const K &end) const {
+        if (!(start < end) || end <= min_key || max_key < start) {
+            return false;
+        }
+        std::size_t first = bucket(std::max(start, min_key));
+        std::size_t last = bucket(std::min(end, max_key));
+        for (std::size_t word = first / 64; word <= last / 64; ++word) {
+            std::uint64_t mask = ~0ULL;
+            if (word == first / 64) {
+                mask &= ~0ULL << (first % 64);
+            }
+            if (word == last / 64) {
+                mask &= ~0ULL >> (63 - last % 64);
+            }
+            if (bits[word] & mask) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::size_t memory_usage() const { return bits.capacity() * sizeof(std::uint64_t); }
+};
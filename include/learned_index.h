@@ -0,0 +1,122 @@
+#pragma once
+
+#include "search.h"
+
+#include "fmt/format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief 有序数值key数组上的分段线性模型(learned index), SST创建时构建一次, 之后只读
+ * @details 贪心的shrinking cone分段: 每段内 |predict(key) - pos| <= max_error,
+ *          查找时只需在预测位置附近的误差窗口内搜索
+ */
+template <typename K>
+class PiecewiseLinearIndex {
+    static_assert(std::is_arithmetic_v<K>, "learned index only supports arithmetic keys");
+
+    struct Segment {
+        double slope;
+        // 该段第一个key在有序数组中的位置
+        std::uint32_t start;
+    };
+
+    // 各段第一个key, 单独存放以便用KeySearch定位段
+    std::vector<K> first_keys;
+    std::vector<Segment> segments;
+    // 各段实际的最大误差(浮点舍入后)
+    std::size_t max_error = 0;
+    std::size_t num_keys = 0;
+
+  public:
+    PiecewiseLinearIndex() = default;
+
+    /**
+     * @param keys 有序数组[keys, keys + n), 段的起点和查找结果都是相对于keys的下标
+     */
+    PiecewiseLinearIndex(const K *keys, std::size_t n, std::size_t epsilon) : num_keys(n) {
+        std::size_t start = 0;
+        while (start < n) {
+            // 可行斜率区间[lo, hi]
+            double lo = 0;
+            double hi = std::numeric_limits<double>::infinity();
+            std::size_t end = start + 1;
+            for (; end < n; ++end) {
+                double dx = static_cast<double>(keys[end]) - static_cast<double>(keys[start]);
+                double dy = static_cast<double>(end - start);
+                double new_lo = std::max(lo, (dy - epsilon) / dx);
+                double new_hi = std::min(hi, (dy + epsilon) / dx);
+                if (new_lo > new_hi) {
+                    break;
+                }
+                lo = new_lo;
+                hi = new_hi;
+            }
+            double slope = std::isinf(hi) ? 0 : (lo + hi) / 2;
+            first_keys.push_back(keys[start]);
+            segments.push_back({slope, static_cast<std::uint32_t>(start)});
+            for (std::size_t i = start; i < end; ++i) {
+                std::size_t predicted = predict(segments.size() - 1, keys[i]);
+                max_error = std::max(max_error, predicted > i ? predicted - i : i - predicted);
+            }
+            start = end;
+        }
+    }
+
+    bool empty() const { return segments.empty(); }
+    std::size_t segment_count() const { return segments.size(); }
+    std::size_t get_max_error() const { return max_error; }
+
+    std::size_t memory_usage() const {
+        return first_keys.capacity() * sizeof(K) + segments.capacity() * sizeof(Segment);
+    }
+
+    /**
+     * @param keys 构建时使用的有序数组的起点
+     * @return 第一个>=key的位置, 不存在则返回构建时的n
+     */
+    std::size_t lower_bound(const K *keys, const K &key) const {
+        std::size_t segment = KeySearch<K>::lower_bound(first_keys.data(), first_keys.size(), key);
+        // 落在段首key上或之后的key属于该段, 小于所有段首的key结果只能是0
+        if (segment < first_keys.size() && !(key < first_keys[segment])) {
+            return segments[segment].start;
+        }
+        if (segment == 0) {
+            return 0;
+        }
+        --segment;
+        std::size_t predicted = predict(segment, key);
+        // 段间空隙中的key的结果最多是下一段的起点
+        std::size_t segment_end = segment + 1 < segments.size() ? segments[segment + 1].start : num_keys;
+        std::size_t lo = predicted > max_error + 1 ? predicted - max_error - 1 : 0;
+        lo = std::max<std::size_t>(lo, segments[segment].start);
+        std::size_t hi = std::min(predicted + max_error + 1, segment_end);
+        return lo + KeySearch<K>::lower_bound(keys + lo, hi - lo, key);
+    }
+
+  private:
+    // 预测值截断到该段的范围内
+    std::size_t predict(std::size_t segment, const K &key) const {
+        const Segment &seg = segments[segment];
+        double offset = seg.slope * (static_cast<double>(key) - static_cast<double>(first_keys[segment]));
+        std::size_t segment_end = segment + 1 < segments.size() ? segments[segment + 1].start : num_keys;
+        double pos = std::min(static_cast<double>(seg.start) + std::max(offset, 0.0), static_cast<double>(segment_end));
+        return static_cast<std::size_t>(std::llround(pos));
+    }
+};
+
+template <typename K>
+struct fmt::formatter<PiecewiseLinearIndex<K>> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const PiecewiseLinearIndex<K> &index, FormatContext &ctx) const {
+        return fmt::format_to(
+            ctx.out(), "PLA{{segments: {}, bytes: {}, max_error: {}}}", index.segment_count(), index.memory_usage(),
+            index.get_max_error()
+        );
+    }
+};
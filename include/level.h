@@ -1,100 +1,353 @@
 #pragma once
 
 #include "log.h"
+#include "options.h"
+#include "policy.h"
 #include "sst.h"
-#include "config.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <list>
+#include <map>
 
-template <typename K, typename V>
+/**
+ * @brief 每层的flush/compaction统计
+ */
+struct LevelStats {
+    // 以该层为输出的compaction次数
+    std::size_t compactions = 0;
+    // 其中输入按key范围拆分为多个子compaction并行归并的compaction数
+    std::size_t split_compactions = 0;
+    // 写入该层的SST数和entry数(flush/compaction的输出), 用于计算写放大
+    std::size_t ssts_written = 0;
+    std::size_t entries_written = 0;
+    // 写入该层的key和value的字节数, value分离后只计BlobIndex
+    std::size_t bytes_written = 0;
+    // 写入该层的SST构建filter的耗时
+    std::chrono::nanoseconds filter_build_time{0};
+    // 不重写直接移动到该层的SST数(不计入ssts_written)
+    std::size_t trivial_moves = 0;
+    // Fifo下因超过大小或存在时间, 或者所有entry都已过期(TTL)而被删除的SST数和entry数
+    std::size_t ssts_deleted = 0;
+    std::size_t entries_deleted = 0;
+};
+
+/**
+ * @brief 每层的范围/前缀查询统计
+ */
+struct ScanStats {
+    // 实际seek并读取的SST数
+    std::size_t ssts_scanned = 0;
+    // 被filter跳过的SST数
+    std::size_t ssts_skipped = 0;
+    // 读取了但区间内没有任何key的SST数(filter的假阳性)
+    std::size_t ssts_false_positive = 0;
+
+    /**
+     * @return 区间内没有key的SST中, 没能被filter跳过的比例
+     */
+    double false_positive_rate() const {
+        std::size_t negatives = ssts_skipped + ssts_false_positive;
+        return negatives == 0 ? 0 : static_cast<double>(ssts_false_positive) / negatives;
+    }
+};
+
+/*
+每层的合并策略由compact_type决定(LazyLeveling下各层不同): Leveling的层是有序run, 其余的层(包括L0)由若干互相重叠的run组成.
+Leveling下L1及以后的层是一个有序run: 由多个key范围互不重叠, 最多Options::file_entries个key的SST组成, 按key升序排列;
+compaction只选出本层的一个SST(L0则是全部SST), 与下一层中key范围重叠的SST合并, 输出重新切分后替换这些SST,
+下一层其余的SST不会被重写.
+最后一层没有容量上限: Leveling的最后一层只接收上一层的合并(同时丢弃旧版本和删除标记);
+Tiering(或只有L0时)最后一层的SST数超过上限后把本层所有SST合并为一个, 仍然留在本层.
+Universal的L0的下一层直接是最后一层, L0中的run由compact_universal选择合并.
+Fifo只使用L0, 它的compaction只删除最旧的SST.
+Policy固定了所有层相同的合并策略时, 按合并策略的分支在编译期确定
+*/
+template <typename K, typename V, typename Policy = DefaultPolicy>
 class Level {
+    static constexpr std::optional<CompactType> fixed_compact_type = uniform_compact_type<Policy>();
+
+    // 所在LevelStorage的配置
+    const Options *options;
     std::size_t level_num;
-    // 新的在后面
+    // 该层的合并策略, 只会是Leveling, Tiering或Universal/Fifo(只有L0)
+    CompactType compact_type;
+    // L0和Tiering: 新的在后面; Leveling的L1+: 按key升序
     std::list<SST<K, V>> ssts;
+    // L0和Tiering下的最大SST数
     std::size_t max_ssts;
-    Level<K, V> *next_level;
+    // Leveling下L1+的最大entry数
+    std::size_t max_entries;
+    // Leveling下一次compaction选出的最后一个key, 下次从它之后的SST开始轮转选择
+    std::optional<K> compact_cursor;
+    // Universal的L0增量降低空间放大时, 正在按key从小到大逐个窗口合并入最后一层的run(从旧到新, 比ssts中的run旧);
+    // 其中小于drained_until的key已经合并入最后一层, 读取和合并时跳过
+    std::list<SST<K, V>> draining;
+    std::optional<K> drained_until;
+    // 有draining run时, 每次flush之后合并一个窗口
+    bool window_due = false;
+    // 写入该层的SST使用的filter类型
+    FilterType filter_type;
+    // 写入该层的SST据此构建prefix filter
+    PrefixExtractor<K> prefix_extractor;
+    // 读取和compaction时合并merge operand
+    VersionMerger<V> version_merger;
+    // 写入该层的compaction输出经过该filter
+    CompactionFilter<K, V> compaction_filter;
+    Level *next_level;
+    LevelStats stats;
+    mutable ScanStats scan_stats;
 
-    friend class fmt::formatter<Level<K, V>>;
+    friend class fmt::formatter<Level<K, V, Policy>>;
 
   public:
-    explicit Level(std::size_t level_num, std::size_t max_ssts, Level<K, V> *next_level = nullptr)
-        : level_num(level_num), max_ssts(max_ssts), next_level(next_level) {}
+    explicit Level(
+        const Options *options, std::size_t level_num, CompactType compact_type, std::size_t max_ssts,
+        std::size_t max_entries, FilterType filter_type, Level *next_level = nullptr
+    )
+        : options(options), level_num(level_num), compact_type(compact_type), max_ssts(max_ssts),
+          max_entries(max_entries), filter_type(filter_type), next_level(next_level) {}
 
     void add_sst(SST<K, V> sst) {
+        push_sst(std::move(sst));
+        while (needs_compaction()) {
+            compact();
+        }
+    }
+
+    /**
+     * @brief 只加入SST, 不进行compaction(后台compaction时flush使用)
+     */
+    void push_sst(SST<K, V> sst) {
         // 如果是merge的SST, 则大小不定
         LOG_DEBUG("adding SST {} to level {}", sst, level_num);
-        sst.set_max_size(CONFIG::NUM_SST_ENTRY * std::pow(CONFIG::NUM_LEVEL_MULTI, level_num));
+        sst.set_max_size(options->sst_entries * std::pow(level_multi_of<Policy>(*options), level_num));
         LOG_DEBUG("SST {} set max size to {}", sst, sst.get_max_size());
+        record_written(sst);
         ssts.push_back(std::move(sst));
-        if (needs_compaction()) {
-            compact();
-        }
+        window_due = !draining.empty();
     }
 
-    void set_next_level(Level<K, V> *next_level) {
+    void set_next_level(Level *next_level) {
         this->next_level = next_level;
     }
 
+    void set_max_entries(std::size_t max_entries) {
+        this->max_entries = max_entries;
+    }
+
+    void set_max_ssts(std::size_t max_ssts) {
+        this->max_ssts = max_ssts;
+    }
+
+    // 只影响之后写入该层的SST
+    void set_filter_type(FilterType filter_type) {
+        this->filter_type = filter_type;
+    }
+
+    void set_prefix_extractor(PrefixExtractor<K> prefix_extractor) {
+        this->prefix_extractor = std::move(prefix_extractor);
+    }
+
+    void set_version_merger(VersionMerger<V> version_merger) {
+        this->version_merger = std::move(version_merger);
+    }
+
+    void set_compaction_filter(CompactionFilter<K, V> compaction_filter) {
+        this->compaction_filter = std::move(compaction_filter);
+    }
+
     std::optional<V> get(const K &key) const {
-        // 从新到旧遍历SST
-        for (auto it = ssts.rbegin(); it != ssts.rend(); ++it) {
-            auto result = it->get(key);
+        std::optional<V> result;
+        get(key, result);
+        return result;
+    }
+
+    /**
+     * @brief 从新到旧查找key, 找到merge operand时继续查找更旧的版本并与之合并; 删除标记使更旧的版本不可见
+     * @param result 更新的数据中已经找到的merge operand(没有时为nullopt), 返回时为合并后的结果
+     * @return 已经得到完整的value, 不需要再查找更旧的层
+     */
+    bool get(const K &key, std::optional<V> &result) const {
+        return for_each_version(key, [&](const std::optional<V> &found) {
             if (result.has_value()) {
-                LOG_DEBUG("key={}, found in level {}", key, level_num);
-                return result;
+                result = version_merger(found, *result);
+            } else {
+                result = found;
             }
+            return !found.has_value() || !is_merge_operand(result);
+        });
+    }
+
+    /**
+     * @brief 从新到旧查找key的第一个不是merge operand的版本(更新的merge operand合并到它上面), 不做合并
+     * @return 找到该版本(包括删除标记)时返回true
+     */
+    bool get_base(const K &key, std::optional<V> &base) const {
+        return for_each_version(key, [&](const std::optional<V> &found) {
+            if (is_merge_operand(found)) {
+                return false;
+            }
+            base = found;
+            return true;
+        });
+    }
+
+    /**
+     * @brief 从新到旧对每个SST调用SST::scan, skip(sst)为true的SST直接跳过
+     */
+    template <typename InRange, typename Skip>
+    void scan(const K &start, InRange &&in_range, Skip &&skip, std::map<K, std::optional<V>> &result) const {
+        auto scan_ssts = [&](const std::list<SST<K, V>> &list, const K &from) {
+            for (auto it = list.rbegin(); it != list.rend(); ++it) {
+                if (skip(*it)) {
+                    ++scan_stats.ssts_skipped;
+                    continue;
+                }
+                ++scan_stats.ssts_scanned;
+                if (it->scan(from, in_range, result, version_merger) == 0) {
+                    ++scan_stats.ssts_false_positive;
+                }
+            }
+        };
+        scan_ssts(ssts, start);
+        scan_ssts(draining, drained_until.has_value() && start < *drained_until ? *drained_until : start);
+    }
+
+    /**
+     * @return 该层中有SST的key范围与[smallest, largest]重叠
+     */
+    bool overlaps(const K &smallest, const K &largest) const {
+        auto overlapping = [&](const SST<K, V> &sst) { return key_range_overlaps(sst, smallest, largest); };
+        return std::any_of(ssts.begin(), ssts.end(), overlapping) ||
+               std::any_of(draining.begin(), draining.end(), overlapping);
+    }
+
+    /**
+     * @brief 不读取entry, 直接删除所有entry都已过期的SST
+     * @details 过期的entry仍然遮挡更旧的版本, 只有更旧的数据(该层中更早的SST, 以及older_overlaps(smallest, largest)
+     *          表示的更下面的层)中没有该key范围时才能删除
+     */
+    template <typename OlderOverlaps>
+    void drop_expired_ssts(std::int64_t now, OlderOverlaps &&older_overlaps) {
+        for (auto it = ssts.begin(); it != ssts.end();) {
+            if (!it->is_expired(now)) {
+                ++it;
+                continue;
+            }
+            auto [smallest, largest] = it->get_key_range();
+            auto overlapping = [&](const SST<K, V> &sst) { return key_range_overlaps(sst, smallest, largest); };
+            bool shadows = older_overlaps(smallest, largest) || std::any_of(ssts.begin(), it, overlapping) ||
+                           std::any_of(draining.begin(), draining.end(), overlapping);
+            if (shadows) {
+                ++it;
+                continue;
+            }
+            LOG_INFO("L{}: deleting expired SST with {} entries", level_num, it->size());
+            ++stats.ssts_deleted;
+            stats.entries_deleted += it->size();
+            it = ssts.erase(it);
         }
-        LOG_DEBUG("key={}, not found in level {}", key, level_num);
-        return std::nullopt;
     }
 
     const std::list<SST<K, V>>& get_ssts() const { return ssts; }
+    // Universal的L0正在逐个窗口合并入最后一层的run, 不计入get_sst_count
+    const std::list<SST<K, V>>& get_draining_ssts() const { return draining; }
     std::size_t get_sst_count() const { return ssts.size(); }
+    // 包括draining run中还没有合并入最后一层的entry
+    std::size_t get_entry_count() const {
+        std::size_t entries = 0;
+        for (const auto &sst : ssts) {
+            entries += sst.size();
+        }
+        for (const auto &sst : draining) {
+            entries += sst.size() - (drained_until.has_value() ? sst.seek(*drained_until) : 0);
+        }
+        return entries;
+    }
     std::size_t get_level_num() const { return level_num; }
+    CompactType get_compact_type() const {
+        if constexpr (fixed_compact_type.has_value()) {
+            return *fixed_compact_type;
+        } else {
+            return compact_type;
+        }
+    }
+    std::size_t get_max_entries() const { return max_entries; }
+    const Level *get_next_level() const { return next_level; }
+    FilterType get_filter_type() const { return filter_type; }
+    const PrefixExtractor<K>& get_prefix_extractor() const { return prefix_extractor; }
+    const LevelStats& get_stats() const { return stats; }
+    const ScanStats& get_scan_stats() const { return scan_stats; }
+    // Leveling的L1+: SST按key升序且互不重叠
+    bool is_sorted_run() const { return get_compact_type() == CompactType::Leveling && level_num != 0; }
+
+    bool is_last_level() const { return next_level == nullptr; }
+
+    /**
+     * @return 本层compaction需要重写的entry数: 有序run为超出容量的部分, 其余为整层
+     */
+    std::size_t get_compaction_debt() const {
+        if (!needs_compaction()) {
+            return 0;
+        }
+        return is_sorted_run() ? get_entry_count() - max_entries : get_entry_count();
+    }
+
     bool needs_compaction() const {
         LOG_DEBUG("level {}", *this);
-        if (CONFIG::compact_type == CompactType::Leveling && level_num != 0) {
-            return ssts.front().is_full() || ssts.size() > max_ssts;
+        if (get_compact_type() == CompactType::Fifo) {
+            return fifo_expired();
+        }
+        if (is_sorted_run()) {
+            return !is_last_level() && get_entry_count() > max_entries;
         } else {
-            return ssts.size() > max_ssts;
+            return window_due || ssts.size() > max_ssts;
         }
     }
 
-    void clear() { ssts.clear(); }
+    void clear() {
+        ssts.clear();
+        draining.clear();
+        drained_until.reset();
+        window_due = false;
+    }
 
     void compact() {
         ASSERT_FATAL(needs_compaction() == true);
-        ASSERT_FATAL(next_level);
+        if (get_compact_type() == CompactType::Fifo) {
+            compact_fifo();
+            return;
+        }
+        if (is_last_level()) {
+            compact_last_level();
+            return;
+        }
+        if (get_compact_type() == CompactType::Universal) {
+            compact_universal();
+            return;
+        }
         LOG_INFO("Compacting L{} with L{}:", level_num, next_level->level_num);
         LOG_DEBUG("\t{}",*this);
         LOG_DEBUG("\t{}", *next_level);
-        if (CONFIG::compact_type == CompactType::Leveling && level_num != 0) {
-            // L_{i-1}+L_{i}->L_i)
-            if (next_level == nullptr) {
-                // TODO
-                LOG_FATAL("Compacting Lmax!");
-                return;
+        if (next_level->is_sorted_run()) {
+            // 有序run: 轮转选出一个SST; 其余: 全部SST(互相重叠)
+            std::list<SST<K, V>> inputs;
+            if (is_sorted_run()) {
+                inputs.splice(inputs.end(), ssts, pick_compaction_input());
+            } else {
+                inputs.splice(inputs.end(), ssts);
             }
-            ASSERT_FATAL(ssts.size() <= 2);
-            ASSERT_FATAL(next_level->ssts.size() <= 1);
-            std::list<SST<K, V>> to_be_merged_ssts = std::move(ssts);
-            to_be_merged_ssts.splice(to_be_merged_ssts.end(), next_level->ssts);
-
-            ASSERT_FATAL(next_level->ssts.size() == 0);
-
-            auto merged_sst = SST<K, V>::merge(std::move(to_be_merged_ssts));
-
-            // 添加到下一层
-            next_level->add_sst(std::move(merged_sst));
-
-            ASSERT_FATAL(ssts.size() == 0);
-            ASSERT_FATAL(next_level->ssts.size() <= 1);
+            next_level->compact_into_run(std::move(inputs));
         } else {
             // 合并当前层的所有SST
-            auto merged_sst = SST<K, V>::merge(std::move(ssts));
+            next_level->record_compaction(ssts);
+            auto merged_sst = SST<K, V>::merge(
+                std::move(ssts), next_level->filter_type, next_level->prefix_extractor, false, version_merger,
+                next_level->compaction_filter, *options
+            );
             next_level->add_sst(std::move(merged_sst));
             ASSERT_FATAL(ssts.size() == 0);
         }
@@ -102,14 +355,366 @@ class Level {
         LOG_DEBUG("\t{}",*this);
         LOG_DEBUG("\t{}", *next_level);
     }
+
+  private:
+    /**
+     * @brief 从新到旧对本层中key的每个版本调用visit(found), visit返回true时停止
+     * @return visit是否返回了true
+     */
+    template <typename Visit>
+    bool for_each_version(const K &key, Visit &&visit) const {
+        if (is_sorted_run()) {
+            // 有序run中只有最后一个第一个key<=key的SST可能包含key; 按第一个key二分, 只比较O(log n)次key
+            auto it = std::upper_bound(ssts.begin(), ssts.end(), key, [](const K &key, const SST<K, V> &sst) {
+                return key < sst.get_key_range().first;
+            });
+            if (it == ssts.begin()) {
+                return false;
+            }
+            --it;
+            std::size_t pos = it->find(key);
+            return pos < it->size() && visit(it->value_at(pos));
+        }
+        for (auto it = ssts.rbegin(); it != ssts.rend(); ++it) {
+            std::size_t pos = it->find(key);
+            if (pos == it->size()) {
+                continue;
+            }
+            LOG_DEBUG("key={}, found in level {}", key, level_num);
+            if (visit(it->value_at(pos))) {
+                return true;
+            }
+        }
+        if (!drained_until.has_value() || !(key < *drained_until)) {
+            for (auto it = draining.rbegin(); it != draining.rend(); ++it) {
+                std::size_t pos = it->find(key);
+                if (pos < it->size() && visit(it->value_at(pos))) {
+                    return true;
+                }
+            }
+        }
+        LOG_DEBUG("key={}, not found in level {}", key, level_num);
+        return false;
+    }
+
+    /**
+     * @brief 最后一层自身合并为一个SST, 不再有更旧的数据, 删除标记可以丢弃
+     */
+    void compact_last_level() {
+        LOG_INFO("Compacting last level L{} into itself", level_num);
+        record_compaction(ssts);
+        auto merged_sst = SST<K, V>::merge(
+            std::move(ssts), filter_type, prefix_extractor, true, version_merger, compaction_filter, *options
+        );
+        ssts.clear();
+        record_written(merged_sst);
+        if (!merged_sst.empty()) {
+            ssts.push_back(std::move(merged_sst));
+        }
+    }
+
+    static bool key_range_overlaps(const SST<K, V> &sst, const K &smallest, const K &largest) {
+        return !(sst.get_key_range().second < smallest || largest < sst.get_key_range().first);
+    }
+
+    // Fifo: 超过总大小, 或最旧的SST超过存在时间
+    bool fifo_expired() const {
+        if (ssts.empty()) {
+            return false;
+        }
+        if (options->fifo_max_entries > 0 && get_entry_count() > options->fifo_max_entries) {
+            return true;
+        }
+        return options->fifo_ttl.count() > 0 &&
+               now_millis() - ssts.front().get_creation_time() > options->fifo_ttl.count();
+    }
+
+    /**
+     * @brief Fifo的compaction: 删除最旧的SST直到不再超过限制, 不重写任何数据
+     */
+    void compact_fifo() {
+        while (fifo_expired()) {
+            LOG_INFO("L{}: FIFO deleting oldest SST with {} entries", level_num, ssts.front().size());
+            ++stats.ssts_deleted;
+            stats.entries_deleted += ssts.front().size();
+            ssts.pop_front();
+        }
+    }
+
+    /**
+     * @brief Universal下L0的compaction, 依次尝试: 降低空间放大, 合并大小相近的run, 减少run数
+     * @details 增量降低空间放大期间只合并draining的下一个窗口, 或者在新的run之间减少run数
+     */
+    void compact_universal() {
+        if (!draining.empty()) {
+            if (window_due) {
+                compact_draining_window();
+            } else {
+                LOG_INFO("L{}: merging newest runs while draining into L{}", level_num, next_level->level_num);
+                merge_runs(std::prev(ssts.end(), ssts.size() - max_ssts + 1), ssts.end());
+            }
+            return;
+        }
+        // 最后一层为空时没有空间放大, 由merge_similar_runs把最旧的run合并入最后一层
+        std::size_t older = next_level->get_entry_count();
+        if (older > 0 && get_entry_count() * 100 > options->universal_max_space_amp_percent * older) {
+            LOG_INFO("L{}: space amplification compaction into L{}", level_num, next_level->level_num);
+            reduce_space_amp();
+            return;
+        }
+        if (merge_similar_runs(older)) {
+            return;
+        }
+        LOG_INFO("L{}: merging newest runs to reduce run count", level_num);
+        merge_runs(std::prev(ssts.end(), ssts.size() - max_ssts + 1), ssts.end());
+    }
+
+    /**
+     * @brief 从新到旧寻找大小相近的一段run; 一直延伸到最旧的run且与最后一层大小相近时, 把这些run合并入最后一层
+     * @return 是否进行了合并
+     */
+    bool merge_similar_runs(std::size_t older) {
+        auto similar = [&](std::size_t size, std::size_t accumulated) {
+            return size * 100 <= accumulated * (100 + options->universal_size_ratio);
+        };
+        for (auto start = ssts.end(); start != ssts.begin();) {
+            --start;
+            auto first = start;
+            std::size_t accumulated = start->size();
+            std::size_t width = 1;
+            while (first != ssts.begin() && similar(std::prev(first)->size(), accumulated)) {
+                --first;
+                accumulated += first->size();
+                ++width;
+            }
+            if (first == ssts.begin() && similar(older, accumulated)) {
+                LOG_INFO("L{}: merging {} oldest runs into L{}", level_num, width, next_level->level_num);
+                merge_into_last_level(std::next(start));
+                return true;
+            }
+            if (width >= options->universal_min_merge_width) {
+                LOG_INFO("L{}: merging {} runs of similar size", level_num, width);
+                merge_runs(first, std::next(start));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 把[first, last)的run合并为一个, 放回原来的位置
+    void merge_runs(typename std::list<SST<K, V>>::iterator first, typename std::list<SST<K, V>>::iterator last) {
+        std::list<SST<K, V>> inputs;
+        inputs.splice(inputs.end(), ssts, first, last);
+        record_compaction(inputs);
+        auto merged_sst = SST<K, V>::merge(
+            std::move(inputs), filter_type, prefix_extractor, false, version_merger, compaction_filter, *options
+        );
+        record_written(merged_sst);
+        ssts.insert(last, std::move(merged_sst));
+    }
+
+    void reduce_space_amp() { merge_into_last_level(ssts.end()); }
+
+    /**
+     * @brief 把L0中最旧的run[ssts.begin(), last)合并入最后一层; 增量模式下这些run转为draining,
+     *        之后每次compaction(每次flush之后一次)按key从小到大只合并一个窗口: 最后一层中universal_incremental_files个
+     *        相邻文件的key范围, 与每个draining run中落在该范围内的片段. 每次compaction的工作量有界, draining run不会被重写
+     */
+    void merge_into_last_level(typename std::list<SST<K, V>>::iterator last) {
+        std::list<SST<K, V>> inputs;
+        inputs.splice(inputs.end(), ssts, ssts.begin(), last);
+        std::size_t window = options->universal_incremental_files;
+        if (window == 0 || next_level->ssts.size() <= window) {
+            next_level->compact_into_run(std::move(inputs));
+            return;
+        }
+        LOG_INFO("L{}: draining {} runs into L{} incrementally", level_num, inputs.size(), next_level->level_num);
+        draining = std::move(inputs);
+        drained_until.reset();
+        compact_draining_window();
+    }
+
+    /**
+     * @brief 把draining run中从drained_until开始的下一个窗口合并入最后一层, 最后一个窗口之后删除所有draining run
+     */
+    void compact_draining_window() {
+        window_due = false;
+        auto &run = next_level->ssts;
+        auto window_first = run.begin();
+        if (drained_until.has_value()) {
+            window_first = std::find_if(run.begin(), run.end(), [&](const SST<K, V> &sst) {
+                return !(sst.get_key_range().second < *drained_until);
+            });
+        }
+        std::size_t files = std::max<std::size_t>(options->universal_incremental_files, 1);
+        auto window_end = window_first;
+        for (std::size_t i = 0; i < files && window_end != run.end(); ++i) {
+            ++window_end;
+        }
+        // 窗口为[drained_until, 窗口之后第一个文件的最小key), 包括文件之间空隙中的key; 第一个和最后一个窗口向外无界
+        std::optional<K> hi;
+        if (window_end != run.end()) {
+            hi = window_end->get_key_range().first;
+        }
+
+        // 从旧到新, 只复制窗口内的片段
+        std::list<SST<K, V>> inputs;
+        for (const auto &sst : draining) {
+            std::size_t first = drained_until.has_value() ? sst.seek(*drained_until) : 0;
+            std::size_t last = hi.has_value() ? sst.seek(*hi) : sst.size();
+            if (first < last) {
+                inputs.push_back(SST<K, V>::slice(
+                    sst, first, last, next_level->filter_type, next_level->prefix_extractor, *options
+                ));
+            }
+        }
+        if (hi.has_value()) {
+            drained_until = hi;
+        } else {
+            LOG_INFO("L{}: finished draining {} runs into L{}", level_num, draining.size(), next_level->level_num);
+            draining.clear();
+            drained_until.reset();
+        }
+        LOG_DEBUG("L{}: incremental compaction of {} slices into L{}", level_num, inputs.size(), next_level->level_num);
+        if (!inputs.empty()) {
+            next_level->compact_into_run(std::move(inputs));
+        }
+    }
+
+    // 在合并inputs之前调用, 与SST::merge/merge_split使用相同的采样判断是否拆分
+    void record_compaction(const std::list<SST<K, V>> &inputs) {
+        ++stats.compactions;
+        std::size_t total = 0;
+        for (const auto &sst : inputs) {
+            total += sst.size();
+        }
+        if (!SST<K, V>::sample_boundaries(inputs, total, *options).empty()) {
+            ++stats.split_compactions;
+        }
+    }
+
+    void record_written(const SST<K, V> &sst) {
+        ++stats.ssts_written;
+        stats.entries_written += sst.size();
+        stats.bytes_written += sst.get_data_size();
+        stats.filter_build_time += sst.get_filter_build_time();
+    }
+
+    // 从compact_cursor之后的第一个SST开始轮转, 使每个key范围都会被轮流下推
+    typename std::list<SST<K, V>>::iterator pick_compaction_input() {
+        auto it = ssts.begin();
+        if (compact_cursor.has_value()) {
+            it = std::find_if(ssts.begin(), ssts.end(), [&](const SST<K, V> &sst) {
+                return *compact_cursor < sst.get_key_range().first;
+            });
+            if (it == ssts.end()) {
+                it = ssts.begin();
+            }
+        }
+        compact_cursor = it->get_key_range().second;
+        return it;
+    }
+
+    /**
+     * @brief 把inputs中与本层有序run和其它输入的key范围都不重叠的SST逐个移动到有序run中的对应位置, 不合并
+     * @details 多个输入(L0)时不足半个文件的输入仍然合并, 否则flush出的小SST会原样进入下层, 有序run中的文件数过多;
+     *          最后一层中删除标记和merge operand需要合并才能丢弃/合并为value, 含有它们的SST不移动
+     * @return 移动的SST数, 移动的SST从inputs中移除
+     */
+    std::size_t trivial_move(std::list<SST<K, V>> &inputs) {
+        auto overlaps_with = [](const SST<K, V> &a, const SST<K, V> &b) {
+            return !(a.get_key_range().second < b.get_key_range().first) &&
+                   !(b.get_key_range().second < a.get_key_range().first);
+        };
+        const bool single = inputs.size() == 1;
+        auto movable = [&](const SST<K, V> &sst) {
+            // filter与本层的不一致时需要重建
+            if (sst.get_filter_type() != filter_type || (!single && sst.size() * 2 < options->file_entries)) {
+                return false;
+            }
+            if (is_last_level() && sst.has_tombstones_or_operands()) {
+                return false;
+            }
+            return std::none_of(inputs.begin(), inputs.end(), [&](const SST<K, V> &other) {
+                return &other != &sst && overlaps_with(sst, other);
+            });
+        };
+        std::size_t moved = 0;
+        for (auto it = inputs.begin(); it != inputs.end();) {
+            auto next = std::next(it);
+            if (movable(*it)) {
+                const auto [smallest, largest] = it->get_key_range();
+                auto pos = std::upper_bound(ssts.begin(), ssts.end(), largest, [](const K &key, const SST<K, V> &sst) {
+                    return key < sst.get_key_range().first;
+                });
+                if (pos == ssts.begin() || std::prev(pos)->get_key_range().second < smallest) {
+                    LOG_DEBUG("L{}: trivially moving SST {}", level_num, *it);
+                    it->set_max_size(options->file_entries);
+                    ssts.splice(pos, inputs, it);
+                    ++stats.trivial_moves;
+                    ++moved;
+                }
+            }
+            it = next;
+        }
+        return moved;
+    }
+
+    /**
+     * @brief 把上一层的inputs(更新)与本层有序run中key范围重叠的SST(更旧)合并, 输出替换这些SST
+     */
+    void compact_into_run(std::list<SST<K, V>> inputs) {
+        ASSERT_FATAL(is_sorted_run());
+        ASSERT_FATAL(!inputs.empty());
+        trivial_move(inputs);
+        if (inputs.empty()) {
+            while (needs_compaction()) {
+                compact();
+            }
+            return;
+        }
+        K smallest = inputs.front().get_key_range().first;
+        K largest = inputs.front().get_key_range().second;
+        for (const auto &sst : inputs) {
+            smallest = std::min(smallest, sst.get_key_range().first);
+            largest = std::max(largest, sst.get_key_range().second);
+        }
+        // 有序run中与[smallest, largest]重叠的SST是连续的一段[first, last)
+        auto first = std::find_if(ssts.begin(), ssts.end(), [&](const SST<K, V> &sst) {
+            return !(sst.get_key_range().second < smallest);
+        });
+        auto last = std::find_if(first, ssts.end(), [&](const SST<K, V> &sst) {
+            return largest < sst.get_key_range().first;
+        });
+        std::list<SST<K, V>> to_be_merged_ssts;
+        to_be_merged_ssts.splice(to_be_merged_ssts.end(), ssts, first, last);
+        LOG_DEBUG("merging {} input SSTs with {} overlapping SSTs in L{}", inputs.size(), to_be_merged_ssts.size(), level_num);
+        to_be_merged_ssts.splice(to_be_merged_ssts.end(), inputs);
+
+        record_compaction(to_be_merged_ssts);
+        // 最后一层中与输入重叠的SST都参与了合并, 删除标记之下不会再有旧版本
+        auto outputs = SST<K, V>::merge_split(
+            std::move(to_be_merged_ssts), options->file_entries, filter_type, prefix_extractor, is_last_level(),
+            version_merger, compaction_filter, *options
+        );
+        for (const auto &sst : outputs) {
+            record_written(sst);
+        }
+        // 其余SST的迭代器在splice后仍然有效, 输出放回原来的位置即保持有序
+        ssts.splice(last, outputs);
+
+        while (needs_compaction()) {
+            compact();
+        }
+    }
 };
 
-template <typename K, typename V>
-struct fmt::formatter<Level<K, V>> : fmt::formatter<std::string_view> {
+template <typename K, typename V, typename Policy>
+struct fmt::formatter<Level<K, V, Policy>> : fmt::formatter<std::string_view> {
     template <typename FormatContext>
-    auto format(const Level<K, V>& level, FormatContext& ctx) const {
+    auto format(const Level<K, V, Policy>& level, FormatContext& ctx) const {
         auto out = ctx.out();
-        out = fmt::format_to(out, "Level{{level_num: {}, sst_num: {}, max_ssts: {}, next_level: {}}}", level.level_num, level.get_sst_count(), level.max_ssts, level.next_level ? static_cast<int>(level.next_level->level_num) : -1);
+        out = fmt::format_to(out, "Level{{level_num: {}, sst_num: {}, max_ssts: {}, max_entries: {}, next_level: {}}}", level.level_num, level.get_sst_count(), level.max_ssts, level.max_entries, level.next_level ? static_cast<int>(level.next_level->level_num) : -1);
         return out;
     }
 };
\ No newline at end of file
@@ -1,93 +1,551 @@
 #pragma once
 
+#include "column_family.h"
+#include "compaction_filter.h"
 #include "config.h"
 #include "log.h"
-#include "mem_table.h"
+#include "merge_operator.h"
+#include "policy.h"
+#include "rate_limiter.h"
 #include "sst.h"
 #include "storage.h"
+#include "stored_value.h"
+#include "write_batch.h"
+#include "write_buffer_manager.h"
+#include "write_controller.h"
 
-#include <list>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-template <typename K, typename V>
+/*
+Options::background_compaction为false时, compaction在flush时同步完成;
+为true时flush只把SST加入L0, 由后台线程逐次执行compaction. 读写和后台compaction由mutex互斥,
+写入前按WriteController的结果减速(等待时不持有锁)或阻塞到compaction完成.
+flush(High)和compaction(Low)写入的entry在写入后向RateLimiter申请令牌, 等待时不持有锁, 读取不受影响
+Options::blob_value_threshold大于0时, flush把大value分离到BlobStore, SST/compaction只处理BlobIndex, 读取时再解析;
+GC把存活的value重新追加后以新的BlobIndex写入MemTable, 与普通写入一样减速, 限速并由新版本覆盖旧版本.
+merge(key, operand)不读取SST: MemTable中已有该key时直接合并, 否则写入merge operand, 由读取和compaction合并到更旧的版本上.
+set_with_ttl写入的entry带有过期时间: 读取时过期的最新版本视为不存在(仍然遮挡更旧的版本), compaction时删除;
+所有entry都已过期的SST在flush时直接删除, 不需要读取.
+数据按column family划分(见column_family.h), 不指定column family的接口使用默认的column family;
+每次写入后向WriteBufferManager(默认进程内共享)上报MemTable的字节数, 超过上限时刷出字节数最多的column family.
+每个column family的配置见options.h; 锁, 后台compaction, 写入控制和限速由整个LSM共享, 使用默认column family的配置.
+Policy(见policy.h)在编译期固定所有column family的compaction策略, filter类型, level_multi和MemTable类型,
+例如LSM<K, V, StaticPolicy<CompactType::Leveling, FilterType::Bloom, 10>>; 默认的DefaultPolicy全部使用Options
+*/
+template <typename K, typename V, typename Policy = DefaultPolicy>
 class LSM {
-    std::unique_ptr<MemTable<K, V>> mem_table;
-    // 最新的在最后
-    std::list<std::unique_ptr<MemTable<K, V>>> immutable_memtables;
-    LevelStorage<K, V> levels;
+    using Stored = StoredValue<V>;
 
-    void flush_memtable() {
-        LOG_INFO("MemTable is full, MemTable->Immutable MemTable");
-        // MemTable full, 则MemTable->Immutable MemTable, 然后新建一个MemTable;
-        immutable_memtables.push_back(std::move(mem_table));
-        mem_table = std::make_unique<MemTable<K, V>>(CONFIG::NUM_MEM_ENTRY);
+    // 下标为ColumnFamilyHandle::id, 0是默认的column family
+    std::vector<std::unique_ptr<ColumnFamily<K, V, Policy>>> column_families;
+    // 后台compaction从该column family开始检查, 各column family轮流compaction
+    std::size_t compaction_cursor = 0;
+    // 使用默认column family的配置
+    WriteController write_controller;
+    RateLimiter rate_limiter;
+    std::shared_ptr<WriteBufferManager> write_buffer_manager = WriteBufferManager::global();
+    // 最后一次向write_buffer_manager上报的MemTable字节数
+    std::size_t reported_bytes = 0;
+    // 正在写回的blob GC数, 写回期间不再嵌套自动GC
+    std::size_t running_blob_gcs = 0;
+
+    mutable std::mutex mutex;
+    // flush产生了compaction工作, 或者一次compaction完成
+    std::condition_variable compaction_cv;
+    bool stopping = false;
+    bool background;
+    // 最后初始化, 启动时其他成员都已就绪
+    std::thread compaction_thread;
+
+    ColumnFamily<K, V, Policy> &family(ColumnFamilyHandle handle) {
+        ASSERT_FATAL(handle.id < column_families.size());
+        return *column_families[handle.id];
+    }
 
+    const ColumnFamily<K, V, Policy> &family(ColumnFamilyHandle handle) const {
+        ASSERT_FATAL(handle.id < column_families.size());
+        return *column_families[handle.id];
+    }
+
+    ColumnFamilyHandle add_column_family(std::string name, ColumnFamilyOptions<K, V> options) {
+        auto column_family = std::make_unique<ColumnFamily<K, V, Policy>>(std::move(name), std::move(options), !background);
+        column_family->set_flush_listener([this]() {
+            if (background) {
+                update_write_controller();
+                compaction_cv.notify_all();
+            }
+        });
+        column_families.push_back(std::move(column_family));
+        return {column_families.size() - 1};
+    }
+
+    // 所有column family的各层写入的entry数之和
+    std::size_t entries_written() const {
+        std::size_t written = 0;
+        for (const auto &column_family : column_families) {
+            written += column_family->get_levels().get_stats().entries_written;
+        }
+        return written;
+    }
+
+    bool needs_compaction() const {
+        return std::any_of(column_families.begin(), column_families.end(), [](const auto &column_family) {
+            return column_family->get_levels().needs_compaction();
+        });
+    }
+
+    /**
+     * @brief MemTable满时flush
+     * @return 刷入L0的entry数, 没有flush时为0
+     */
+    std::size_t make_room(ColumnFamily<K, V, Policy> &column_family) {
+        // MemTable full, 则MemTable->Immutable MemTable, 然后新建一个MemTable;
         // 如果Immutable MemTable也full, 则刷入L0(L0不保证不重叠)
-        if (immutable_memtables.size() > CONFIG::NUM_MAX_MEM_TABLE) {
-            LOG_INFO("Too many ImmutableMemTables, flushing oldest to SST");
+        // 如果L0 full, 则将找到L1中与L0的SST的范围重叠的SST, 一起合并入L1(Leveling)
+        return column_family.is_memtable_full() ? column_family.flush_memtable() : 0;
+    }
+
+    // 所有column family的MemTable和Immutable MemTable的字节数
+    std::size_t memtable_bytes() const {
+        std::size_t bytes = 0;
+        for (const auto &column_family : column_families) {
+            bytes += column_family->get_memtable_bytes();
+        }
+        return bytes;
+    }
 
-            // 将最老的ImmutableMemTable转换为SST并添加到L0
-            std::unique_ptr<MemTable<K, V>> oldest_memtable = std::move(immutable_memtables.front());
-            immutable_memtables.pop_front();
+    // 向WriteBufferManager上报当前的MemTable字节数
+    void report_memory_usage() {
+        std::size_t bytes = memtable_bytes();
+        write_buffer_manager->update(reported_bytes, bytes);
+        reported_bytes = bytes;
+    }
 
-            ASSERT_FATAL(!oldest_memtable->empty());
-            SST<K, V> new_sst(*oldest_memtable);
+    /**
+     * @brief WriteBufferManager超过上限时, 依次刷出MemTable字节数最多的column family中最旧的MemTable
+     * @return 刷入L0的entry数
+     */
+    std::size_t enforce_write_buffer_limit() {
+        report_memory_usage();
+        std::size_t flushed = 0;
+        while (write_buffer_manager->should_flush(reported_bytes)) {
+            auto &largest = *std::max_element(
+                column_families.begin(), column_families.end(),
+                [](const auto &a, const auto &b) { return a->get_memtable_bytes() < b->get_memtable_bytes(); }
+            );
+            LOG_INFO("write buffer full, flushing column family {}", largest->get_name());
+            flushed += largest->flush_oldest_immutable();
+            write_buffer_manager->record_flush();
+            report_memory_usage();
+        }
+        return flushed;
+    }
 
-            levels.add_sst_to_l0(std::move(new_sst));
-            LOG_INFO("Added new SST to L0, now has {} SSTs", levels[0].get_sst_count());
+    /**
+     * @brief 按WriteController减速后调用apply写入MemTable, 再申请flush/compaction的令牌, 调用时持有lock
+     * @param apply 返回其中flush的entry数; 执行期间一直持有锁, 其中的所有写入对读取原子可见
+     */
+    template <typename Apply>
+    void write_locked(std::unique_lock<std::mutex> &lock, Apply &&apply) {
+        delay_write(lock);
+        std::size_t written = entries_written();
+        std::size_t flushed = apply();
+        flushed += enforce_write_buffer_limit();
+        // 同步compaction时compaction的输出也在这次flush中写入
+        charge_io(lock, flushed, entries_written() - written - flushed);
+        // GC的写回本身也经过这里, 其间新封存的文件留到之后的写入再检查
+        if (running_blob_gcs == 0) {
+            for (auto &column_family : column_families) {
+                if (column_family->take_sealed_blob_files()) {
+                    collect_blob_garbage(lock, *column_family, 1);
+                }
+            }
         }
     }
 
+    /**
+     * @brief 检查column_family中最多max_files个封存的blob文件, 调用时持有lock: 检查期间不修改LSM,
+     *        之后与普通写入一样把搬迁的value和合并的结果写回MemTable, 全部写回后删除被GC的文件
+     * @return 删除的blob文件数
+     */
+    std::size_t collect_blob_garbage(
+        std::unique_lock<std::mutex> &lock, ColumnFamily<K, V, Policy> &column_family, std::size_t max_files
+    ) {
+        std::size_t deleted = 0;
+        ++running_blob_gcs;
+        write_locked(lock, [&]() {
+            std::size_t flushed = 0;
+            for (const auto &[key, value] : column_family.collect_blob_garbage(max_files)) {
+                flushed += make_room(column_family);
+                column_family.write_back(key, value);
+            }
+            deleted = column_family.delete_collected_blob_files();
+            return flushed;
+        });
+        --running_blob_gcs;
+        return deleted;
+    }
+
+    /**
+     * @brief 向RateLimiter申请已经写入的entry的令牌, 等待时释放lock
+     */
+    void charge_io(std::unique_lock<std::mutex> &lock, std::size_t flushed, std::size_t compacted) {
+        if (flushed == 0 && compacted == 0) {
+            return;
+        }
+        lock.unlock();
+        rate_limiter.request(flushed, IOPriority::High);
+        rate_limiter.request(compacted, IOPriority::Low);
+        lock.lock();
+    }
+
+    // 同步compaction时flush返回后compaction已经完成, 不会有积压, 只在后台compaction时调用
+    void update_write_controller() {
+        // L0的SST数只在等待compaction时计入(Universal/Fifo的L0平时就有很多SST), 取各column family中最多的
+        std::size_t l0_ssts = 0;
+        std::size_t debt = 0;
+        for (const auto &column_family : column_families) {
+            const auto &levels = column_family->get_levels();
+            if (levels[0].needs_compaction()) {
+                l0_ssts = std::max(l0_ssts, levels[0].get_sst_count());
+            }
+            debt += levels.get_compaction_debt();
+        }
+        write_controller.update(l0_ssts, debt);
+        rate_limiter.auto_tune(debt);
+    }
+
+    /**
+     * @brief 写入前根据WriteController减速或阻塞, 调用时持有lock
+     */
+    void delay_write(std::unique_lock<std::mutex> &lock) {
+        StallCause cause = write_controller.get_cause();
+        if (cause == StallCause::None) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (write_controller.is_stopped()) {
+            LOG_INFO("writes stopped, waiting for compaction");
+            compaction_cv.wait(lock, [&]() { return !write_controller.is_stopped(); });
+        } else {
+            // 等待时释放锁, 让后台compaction继续
+            auto delay = write_controller.get_delay();
+            lock.unlock();
+            std::this_thread::sleep_for(delay);
+            lock.lock();
+        }
+        write_controller.record(cause, std::chrono::steady_clock::now() - start);
+    }
+
+    void compaction_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            compaction_cv.wait(lock, [&]() { return stopping || needs_compaction(); });
+            if (stopping) {
+                return;
+            }
+            std::size_t written = entries_written();
+            for (std::size_t i = 0; i < column_families.size(); ++i) {
+                std::size_t id = (compaction_cursor + i) % column_families.size();
+                if (column_families[id]->get_levels().compact_once()) {
+                    compaction_cursor = id + 1;
+                    break;
+                }
+            }
+            update_write_controller();
+            compaction_cv.notify_all();
+            std::size_t compacted = entries_written() - written;
+            // 每次compaction之间让出锁, 读写不会一直等到所有compaction完成
+            lock.unlock();
+            rate_limiter.request(compacted, IOPriority::Low);
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+
+    static ColumnFamilyOptions<K, V> make_options(
+        PrefixExtractor<K> prefix_extractor, MergeOperator<V> merge_operator, CompactionFilter<K, V> compaction_filter
+    ) {
+        ColumnFamilyOptions<K, V> options;
+        options.prefix_extractor = std::move(prefix_extractor);
+        options.merge_operator = std::move(merge_operator);
+        options.compaction_filter = std::move(compaction_filter);
+        return options;
+    }
+
   public:
-    LSM() : mem_table(std::make_unique<MemTable<K, V>>(CONFIG::NUM_MEM_ENTRY)),
-            levels(CONFIG::NUM_LEVELS) {
-        LOG_INFO("LevelStorage: {}", this->levels);
+    /**
+     * @param options 默认column family的配置, 其中由整个LSM共享的部分(后台compaction, 写入控制, 限速)也取自这里
+     */
+    explicit LSM(ColumnFamilyOptions<K, V> options)
+        : write_controller(options), rate_limiter(options), background(options.background_compaction) {
+        add_column_family("default", std::move(options));
+        write_buffer_manager->add_client();
+        if (background) {
+            compaction_thread = std::thread([this]() { compaction_loop(); });
+        }
     }
 
-    void set(const K &key, const V &value) {
-        LOG_DEBUG("key={}, value={}", key, value);
+    /**
+     * @brief 默认的column family使用以下参数, 其余配置取自CONFIG的当前值
+     * @param prefix_extractor 设置后每个SST会额外构建prefix filter, 以支持prefix_scan跳过无关的SST
+     * @param merge_operator merge()使用的可结合的merge operator
+     * @param compaction_filter compaction输出的每个key/value经过该filter
+     */
+    explicit LSM(
+        PrefixExtractor<K> prefix_extractor = nullptr, MergeOperator<V> merge_operator = nullptr,
+        CompactionFilter<K, V> compaction_filter = nullptr
+    )
+        : LSM(make_options(std::move(prefix_extractor), std::move(merge_operator), std::move(compaction_filter))) {}
 
-        // MemTable是否full
-        if (mem_table->is_full()) {
-            // MemTable full, 则MemTable->Immutable MemTable, 然后新建一个MemTable;
-            // 如果Immutable MemTable也full, 则刷入L0(L0不保证不重叠)
-            // 如果L0 full, 则将找到L1中与L0的SST的范围重叠的SST, 一起合并入L1
-            flush_memtable();
+    ~LSM() {
+        if (compaction_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            // 唤醒可能在等待令牌的后台线程
+            rate_limiter.set_rate(0);
+            compaction_cv.notify_all();
+            compaction_thread.join();
         }
+        write_buffer_manager->remove_client(reported_bytes);
+    }
+
+    static ColumnFamilyHandle default_column_family() { return {}; }
 
-        // (Update/Delete)直接写入MemTable
-        mem_table->set(key, value);
+    /**
+     * @brief 创建一个column family, 与其他column family共享锁, 后台compaction线程和写入控制
+     */
+    ColumnFamilyHandle create_column_family(std::string name, ColumnFamilyOptions<K, V> options = {}) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return add_column_family(std::move(name), std::move(options));
+    }
+
+    void set(const K &key, const V &value) { set(default_column_family(), key, value); }
 
+    void set(ColumnFamilyHandle handle, const K &key, const V &value) {
+        LOG_DEBUG("key={}, value={}", key, value);
+        std::unique_lock<std::mutex> lock(mutex);
+        write_locked(lock, [&]() {
+            auto &column_family = family(handle);
+            std::size_t flushed = make_room(column_family);
+            // (Update/Delete)直接写入MemTable
+            column_family.set(key, value);
+            return flushed;
+        });
         LOG_DEBUG("completed for key={}", key);
     }
 
-    std::optional<V> get(const K &key) const {
+    /**
+     * @brief 写入ttl之后过期的entry, 过期后读取不到, 并在compaction时删除
+     */
+    void set_with_ttl(const K &key, const V &value, std::chrono::milliseconds ttl) {
+        set_with_ttl(default_column_family(), key, value, ttl);
+    }
+
+    void set_with_ttl(ColumnFamilyHandle handle, const K &key, const V &value, std::chrono::milliseconds ttl) {
+        LOG_DEBUG("key={}, value={}, ttl={}ms", key, value, ttl.count());
+        std::unique_lock<std::mutex> lock(mutex);
+        write_locked(lock, [&]() {
+            auto &column_family = family(handle);
+            std::size_t flushed = make_room(column_family);
+            column_family.set(key, value, now_millis() + ttl.count());
+            return flushed;
+        });
+        LOG_DEBUG("completed for key={}", key);
+    }
+
+    /**
+     * @brief 用column family的merge operator把operand合并到key的value上(key不存在时operand就是value)
+     * @details 只读取MemTable: MemTable中已有该key时直接合并, 否则写入merge operand
+     */
+    void merge(const K &key, const V &operand) { merge(default_column_family(), key, operand); }
+
+    void merge(ColumnFamilyHandle handle, const K &key, const V &operand) {
+        LOG_DEBUG("key={}, operand={}", key, operand);
+        std::unique_lock<std::mutex> lock(mutex);
+        write_locked(lock, [&]() {
+            auto &column_family = family(handle);
+            std::size_t flushed = make_room(column_family);
+            column_family.merge(key, operand);
+            return flushed;
+        });
+        LOG_DEBUG("completed for key={}", key);
+    }
+
+    /**
+     * @brief 原子地写入batch中的所有操作, 可以跨column family; 读取要么看到全部写入, 要么一个都看不到
+     */
+    void write(const WriteBatch<K, V> &batch) {
+        LOG_DEBUG("batch of {} writes", batch.size());
+        std::unique_lock<std::mutex> lock(mutex);
+        write_locked(lock, [&]() {
+            std::size_t flushed = 0;
+            for (const auto &op : batch.get_ops()) {
+                auto &column_family = family(op.column_family);
+                flushed += make_room(column_family);
+                if (op.type == WriteBatch<K, V>::Type::Merge) {
+                    column_family.merge(op.key, op.value);
+                } else {
+                    column_family.set(op.key, op.value, op.expire_at);
+                }
+            }
+            return flushed;
+        });
+    }
+
+    std::optional<V> get(const K &key) const { return get(default_column_family(), key); }
+
+    std::optional<V> get(ColumnFamilyHandle handle, const K &key) const {
         LOG_DEBUG("key={}", key);
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).get(key);
+    }
+
+    /**
+     * @brief 范围查询[start, end), 跳过range filter认为区间内没有key的SST
+     */
+    std::vector<std::pair<K, V>> scan(const K &start, const K &end) const {
+        return scan(default_column_family(), start, end);
+    }
+
+    std::vector<std::pair<K, V>> scan(ColumnFamilyHandle handle, const K &start, const K &end) const {
+        LOG_DEBUG("start={}, end={}", start, end);
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).scan(start, end);
+    }
+
+    /**
+     * @return [start, end)中没有(未删除的)key
+     */
+    bool empty_range(const K &start, const K &end) const {
+        return scan(start, end).empty();
+    }
+
+    /**
+     * @brief 查询所有前缀为prefix的entry, 只访问prefix filter认为可能包含该前缀的SST
+     */
+    std::vector<std::pair<K, V>> prefix_scan(const K &prefix) const {
+        return prefix_scan(default_column_family(), prefix);
+    }
 
-        // 1. MemTable
-        auto result = mem_table->get(key);
-        if (result.has_value()) {
-            LOG_DEBUG("key={}, found in MemTable", key);
-            return result;
+    std::vector<std::pair<K, V>> prefix_scan(ColumnFamilyHandle handle, const K &prefix) const {
+        LOG_DEBUG("prefix={}", prefix);
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).prefix_scan(prefix);
+    }
+
+    /**
+     * @brief 等待后台compaction完成所有column family已有的工作
+     */
+    void wait_for_compaction() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (compaction_thread.joinable()) {
+            compaction_cv.wait(lock, [&]() { return !needs_compaction(); });
         }
+    }
 
-        // 2. Immutable MemTable(较新的在后面)
-        for (auto it = immutable_memtables.rbegin(); it != immutable_memtables.rend(); ++it) {
-            result = (*it)->get(key);
-            if (result.has_value()) {
-                LOG_DEBUG("key={}, found in ImmutableMemTable", key);
-                return result;
-            }
+    /**
+     * @brief 检查所有column family中所有封存的blob文件, 重写垃圾比例不低于blob_gc_garbage_ratio的文件
+     * @return 删除的blob文件数
+     */
+    std::size_t garbage_collect_blobs() {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::size_t deleted = 0;
+        for (auto &column_family : column_families) {
+            deleted += collect_blob_garbage(lock, *column_family, column_family->get_blob_store().get_file_count());
         }
+        return deleted;
+    }
 
-        // 3. SST(从L0->Lmax)
-        result = levels.get(key);
-        if (result.has_value()) {
-            return result;
+    /**
+     * @brief 运行时修改column family的配置, 例如MemTable大小, compaction的触发条件和SST的filter;
+     *        修改默认column family时同时修改写入控制和限速
+     * @return 修改了compact_type/num_levels/background_compaction或options不合法(见Options::is_valid)时返回false,
+     *         不做任何修改
+     */
+    bool set_options(ColumnFamilyHandle handle, const Options &options) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &column_family = family(handle);
+        if (!column_family.get_options().is_compatible(options)) {
+            LOG_WARN("column family {}: compact_type/num_levels/background_compaction cannot be changed at runtime",
+                     column_family.get_name());
+            return false;
+        }
+        if (!options.is_valid()) {
+            LOG_WARN("column family {}: invalid options", column_family.get_name());
+            return false;
         }
+        column_family.set_options(options);
+        if (handle.id == default_column_family().id) {
+            write_controller.set_options(options);
+            rate_limiter.set_options(options);
+        }
+        if (background) {
+            // 新的触发条件可能产生了compaction工作, 或者解除了写入的减速/停止
+            update_write_controller();
+            compaction_cv.notify_all();
+        }
+        return true;
+    }
+
+    bool set_options(const Options &options) { return set_options(default_column_family(), options); }
+
+    Options get_options(ColumnFamilyHandle handle = default_column_family()) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).get_options();
+    }
+
+    RateLimiter& get_rate_limiter() { return rate_limiter; }
+
+    /**
+     * @brief 改用manager限制MemTable内存(例如只在几个LSM之间共享上限), 默认使用WriteBufferManager::global()
+     */
+    void set_write_buffer_manager(std::shared_ptr<WriteBufferManager> manager) {
+        std::lock_guard<std::mutex> lock(mutex);
+        write_buffer_manager->remove_client(reported_bytes);
+        write_buffer_manager = std::move(manager);
+        write_buffer_manager->add_client();
+        reported_bytes = 0;
+        report_memory_usage();
+    }
+
+    const WriteBufferManager &get_write_buffer_manager() const { return *write_buffer_manager; }
+
+    StallStats get_stall_stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return write_controller.get_stats();
+    }
+
+    // MemTable和Immutable MemTable中的entry数
+    std::size_t get_memtable_entries(ColumnFamilyHandle handle = default_column_family()) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).get_memtable_entries();
+    }
+
+    // MemTable和Immutable MemTable的字节数
+    std::size_t get_memtable_bytes(ColumnFamilyHandle handle = default_column_family()) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return family(handle).get_memtable_bytes();
+    }
+
+    // 后台compaction时需要先wait_for_compaction, 返回的引用不受锁保护
+    const LevelStorage<K, Stored, Policy>& get_levels(ColumnFamilyHandle handle = default_column_family()) const {
+        return family(handle).get_levels();
+    }
 
-        LOG_DEBUG("key={}, not found", key);
-        return std::nullopt;
+    // 返回的引用不受锁保护
+    const BlobStore<K, V>& get_blob_store(ColumnFamilyHandle handle = default_column_family()) const {
+        return family(handle).get_blob_store();
     }
 };
@@ -1,21 +1,37 @@
 #pragma once
 
+#include "stored_value.h"
+
 #include <map>
 #include <optional>
 #include <cstddef>
 
 template <typename K, typename V>
 class MemTable {
+    // 红黑树每个节点除key/value外的开销(3个指针和颜色), 只用于估算内存
+    static constexpr std::size_t NODE_OVERHEAD = 4 * sizeof(void *);
+
     // 删除操作是插入一个std::nullopt
     std::map<K, std::optional<V>> table;
     std::size_t max_size;
+    // 字节数上限, 0表示只按entry数限制
+    std::size_t max_bytes;
+    // key/value的字节数(EntrySize)加上节点开销的估算
+    std::size_t memory_usage = 0;
 
   public:
-    explicit MemTable(std::size_t max_size = 4) : max_size(max_size) {}
+    explicit MemTable(std::size_t max_size = 4, std::size_t max_bytes = 0) : max_size(max_size), max_bytes(max_bytes) {}
 
     void set(const K &key, const std::optional<V> &value) {
         LOG_DEBUG("MemTable::set key={}, value={}", key, value.value());
-        table[key] = value;
+        auto [it, inserted] = table.try_emplace(key);
+        if (inserted) {
+            memory_usage += entry_size(key) + NODE_OVERHEAD;
+        } else {
+            memory_usage -= entry_size(it->second);
+        }
+        it->second = value;
+        memory_usage += entry_size(value);
     }
 
     std::optional<V> get(const K &key) const {
@@ -28,9 +44,15 @@ class MemTable {
         return std::nullopt;
     }
 
+    void set_limits(std::size_t max_size, std::size_t max_bytes) {
+        this->max_size = max_size;
+        this->max_bytes = max_bytes;
+    }
+
     std::size_t size() const { return table.size(); }
-    bool is_full() const { return table.size() >= max_size; }
+    std::size_t get_memory_usage() const { return memory_usage; }
+    bool is_full() const { return table.size() >= max_size || (max_bytes > 0 && memory_usage >= max_bytes); }
     bool empty() const { return table.empty(); }
 
     const std::map<K, std::optional<V>>& get_table() const { return table; }
-};
\ No newline at end of file
+};
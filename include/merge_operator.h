@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <optional>
+
+/*
+merge operator: LSM::merge(key, operand)只写入一个merge operand, 不读取旧value;
+读取和compaction时从新到旧把operand合并到更旧的版本上, 直到遇到完整的value(或者没有更旧的版本).
+operator要求可结合, 相邻的operand可以先合并为一个operand, 之后再合并到value上
+*/
+
+/**
+ * @brief 用户提供的可结合的merge operator, 返回把operand合并到existing上的结果
+ */
+template <typename V>
+using MergeOperator = std::function<V(const V &existing, const V &operand)>;
+
+/**
+ * @brief SST/Level内部使用: 把同一key较新的merge operand newer合并到较旧的版本older(不存在或删除时为nullopt)上
+ * @details older也是merge operand时结果仍是merge operand, 否则结果是完整的value
+ */
+template <typename V>
+using VersionMerger = std::function<V(const std::optional<V> &older, const V &newer)>;
+
+/**
+ * @brief 判断一个版本是否是merge operand; 只有StoredValue可以是merge operand
+ */
+template <typename T>
+struct MergeOperandTraits {
+    static bool is_operand(const T &) { return false; }
+};
+
+template <typename T>
+bool is_merge_operand(const std::optional<T> &value) {
+    return value.has_value() && MergeOperandTraits<T>::is_operand(*value);
+}
+
+/**
+ * @brief 从新到旧收集时加入key的一个更旧的版本: key还没有版本时插入, 已有的版本是merge operand时与之合并
+ */
+template <typename K, typename V>
+void add_older_version(
+    std::map<K, std::optional<V>> &result, const K &key, const std::optional<V> &older, const VersionMerger<V> &merger
+) {
+    auto [it, inserted] = result.emplace(key, older);
+    if (!inserted && merger && is_merge_operand(it->second)) {
+        it->second = merger(older, *it->second);
+    }
+}
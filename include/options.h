@@ -0,0 +1,98 @@
+#pragma once
+
+#include "config.h"
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/*
+一个LSM实例(column family)的配置. 默认值取自构造Options时的CONFIG: CONFIG仍是进程级的默认值,
+修改CONFIG只影响之后创建的Options, 已经创建的LSM只受自己的Options和set_options()影响.
+LSM::set_options()可以在运行时修改除compact_type/num_levels/background_compaction(决定LSM结构)以外的选项;
+修改对之后创建的MemTable/SST和之后的compaction生效, 已有的SST不会重建
+*/
+struct Options {
+    // MemTable的entry数
+    std::size_t mem_entries = CONFIG::NUM_MEM_ENTRY;
+    // MemTable的字节数上限, 0为只按entry数限制
+    std::size_t mem_bytes = CONFIG::MEM_TABLE_BYTES;
+    // Immutable MemTable超过该数量时把最旧的刷入L0
+    std::size_t max_memtables = CONFIG::NUM_MAX_MEM_TABLE;
+
+    // 整体的compaction策略, 不能在运行时修改
+    CompactType compact_type = CONFIG::compact_type;
+    // 层数, 不能在运行时修改
+    std::size_t num_levels = CONFIG::NUM_LEVELS;
+    // 从L1开始每一层的放大倍数
+    std::size_t level_multi = CONFIG::NUM_LEVEL_MULTI;
+    // L0最多的SST数, 达到后触发L0的compaction
+    std::size_t max_l0_ssts = CONFIG::NUM_MAX_L0_SST;
+    // Leveling下L1及以后每个SST文件的最大entry数
+    std::size_t file_entries = CONFIG::NUM_FILE_ENTRY;
+    // Leveling下根据最后一层的实际大小动态推导各层容量
+    bool dynamic_level_entries = CONFIG::dynamic_level_entries;
+    // LazyLeveling: 除最后一层外/最后一层每层最多的run数
+    std::size_t upper_level_runs = CONFIG::NUM_UPPER_LEVEL_RUNS;
+    std::size_t last_level_runs = CONFIG::NUM_LAST_LEVEL_RUNS;
+    // Universal, 见CONFIG中的同名选项
+    std::size_t universal_max_runs = CONFIG::UNIVERSAL_MAX_RUNS;
+    std::size_t universal_size_ratio = CONFIG::UNIVERSAL_SIZE_RATIO;
+    std::size_t universal_min_merge_width = CONFIG::UNIVERSAL_MIN_MERGE_WIDTH;
+    std::size_t universal_max_space_amp_percent = CONFIG::UNIVERSAL_MAX_SPACE_AMP_PERCENT;
+    std::size_t universal_incremental_files = CONFIG::UNIVERSAL_INCREMENTAL_FILES;
+    // Fifo: L0最多保留的entry数/SST最长的存在时间, 0表示不限制
+    std::size_t fifo_max_entries = CONFIG::FIFO_MAX_ENTRIES;
+    std::chrono::milliseconds fifo_ttl = CONFIG::FIFO_TTL;
+    // 一次compaction的输入按key范围拆分给多少个线程并行归并, 以及拆分需要的最少entry数
+    std::size_t subcompactions = CONFIG::NUM_SUBCOMPACTIONS;
+    std::size_t subcompaction_min_entries = CONFIG::SUBCOMPACTION_MIN_ENTRIES;
+
+    // flush输出的SST的大小
+    std::size_t sst_entries = CONFIG::NUM_SST_ENTRY;
+    // SST的索引和filter按多少个key分区, 0表示不分区
+    std::size_t sst_partition_entries = CONFIG::SST_PARTITION_ENTRY;
+    SearchLayout search_layout = CONFIG::sst_search_layout;
+    std::size_t learned_index_epsilon = CONFIG::LEARNED_INDEX_EPSILON;
+    std::size_t bloom_bits_per_key = CONFIG::BLOOM_BITS_PER_KEY;
+    // level_filter_types中没有指定的层使用filter_type
+    FilterType filter_type = CONFIG::filter_type;
+    std::vector<FilterType> level_filter_types = CONFIG::level_filter_types;
+    std::size_t range_filter_bits_per_key = CONFIG::RANGE_FILTER_BITS_PER_KEY;
+
+    // 不小于该字节数的value在flush时分离到blob文件, 0表示不分离
+    std::size_t blob_value_threshold = CONFIG::BLOB_VALUE_THRESHOLD;
+    std::size_t blob_file_size = CONFIG::BLOB_FILE_SIZE;
+    double blob_gc_garbage_ratio = CONFIG::BLOB_GC_GARBAGE_RATIO;
+    bool blob_auto_gc = CONFIG::blob_auto_gc;
+
+    // 以下由整个LSM共享, 只使用默认column family的值
+    // 后台compaction, 不能在运行时修改
+    bool background_compaction = CONFIG::background_compaction;
+    std::size_t l0_slowdown_ssts = CONFIG::L0_SLOWDOWN_SSTS;
+    std::size_t l0_stop_ssts = CONFIG::L0_STOP_SSTS;
+    std::size_t soft_pending_compaction_entries = CONFIG::SOFT_PENDING_COMPACTION_ENTRIES;
+    std::size_t hard_pending_compaction_entries = CONFIG::HARD_PENDING_COMPACTION_ENTRIES;
+    std::chrono::microseconds max_write_delay = CONFIG::MAX_WRITE_DELAY;
+    // flush和compaction每秒最多写入的entry数, 0表示不限制
+    std::size_t rate_limit_entries_per_sec = CONFIG::RATE_LIMIT_ENTRIES_PER_SEC;
+    std::chrono::milliseconds rate_limit_refill_period = CONFIG::RATE_LIMIT_REFILL_PERIOD;
+    bool rate_limit_auto_tune = CONFIG::RATE_LIMIT_AUTO_TUNE;
+    std::size_t rate_limit_max_multiplier = CONFIG::RATE_LIMIT_MAX_MULTIPLIER;
+
+    /**
+     * @return 各选项的取值合法
+     */
+    bool is_valid() const {
+        // 一次只合并一个run不会减少run数
+        return universal_min_merge_width >= 2;
+    }
+
+    /**
+     * @return other与本配置的LSM结构相同, 可以在运行时切换到other
+     */
+    bool is_compatible(const Options &other) const {
+        return compact_type == other.compact_type && num_levels == other.num_levels &&
+               background_compaction == other.background_compaction;
+    }
+};
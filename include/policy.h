@@ -0,0 +1,93 @@
+#pragma once
+
+#include "config.h"
+#include "mem_table.h"
+#include "options.h"
+
+#include <cstddef>
+#include <optional>
+
+/*
+编译期固定的LSM配置: LSM<K, V, Policy>. Policy固定的选项覆盖Options(包括set_options)中的同名选项,
+Level/LevelStorage按这些选项的分支在编译期确定, 不会使用的compaction路径被编译器去掉.
+Policy需要提供:
+    compact_type: std::optional<CompactType>, nullopt为使用Options::compact_type
+    filter_type: std::optional<FilterType>, nullopt为使用Options::filter_type/level_filter_types
+    level_multi: std::size_t, 0为使用Options::level_multi
+    MemTable<K, V>: MemTable类型, 接口与::MemTable相同
+DefaultPolicy不固定任何选项, 与运行时配置的LSM相同
+*/
+struct DefaultPolicy {
+    static constexpr std::optional<CompactType> compact_type = std::nullopt;
+    static constexpr std::optional<FilterType> filter_type = std::nullopt;
+    static constexpr std::size_t level_multi = 0;
+    template <typename K, typename V>
+    using MemTable = ::MemTable<K, V>;
+};
+
+/**
+ * @brief 固定compaction策略, filter类型和level_multi的Policy, 例如StaticPolicy<CompactType::Leveling, FilterType::Bloom, 10>
+ */
+template <
+    CompactType Compact, FilterType Filter, std::size_t LevelMulti,
+    template <typename, typename> class Table = ::MemTable>
+struct StaticPolicy {
+    static_assert(LevelMulti > 1, "level_multi must be greater than 1");
+
+    static constexpr std::optional<CompactType> compact_type = Compact;
+    static constexpr std::optional<FilterType> filter_type = Filter;
+    static constexpr std::size_t level_multi = LevelMulti;
+    template <typename K, typename V>
+    using MemTable = Table<K, V>;
+};
+
+/**
+ * @return 用Policy固定的选项覆盖后的options
+ */
+template <typename Policy, typename O>
+O apply_policy(O options) {
+    if constexpr (Policy::compact_type.has_value()) {
+        options.compact_type = *Policy::compact_type;
+    }
+    if constexpr (Policy::filter_type.has_value()) {
+        options.filter_type = *Policy::filter_type;
+        options.level_filter_types.clear();
+    }
+    if constexpr (Policy::level_multi != 0) {
+        options.level_multi = Policy::level_multi;
+    }
+    return options;
+}
+
+template <typename Policy>
+constexpr CompactType compact_type_of(const Options &options) {
+    if constexpr (Policy::compact_type.has_value()) {
+        return *Policy::compact_type;
+    } else {
+        return options.compact_type;
+    }
+}
+
+template <typename Policy>
+constexpr std::size_t level_multi_of(const Options &options) {
+    if constexpr (Policy::level_multi != 0) {
+        return Policy::level_multi;
+    } else {
+        return options.level_multi;
+    }
+}
+
+/**
+ * @return Policy固定的compaction策略下所有层都使用的合并策略(Leveling/Tiering/Fifo), 各层不同或未固定时为nullopt
+ * @details LazyLeveling和Universal的各层策略不同, 见LevelStorage::get_compact_type_for_level
+ */
+template <typename Policy>
+constexpr std::optional<CompactType> uniform_compact_type() {
+    if constexpr (Policy::compact_type.has_value()) {
+        constexpr CompactType type = *Policy::compact_type;
+        if (type == CompactType::Leveling || type == CompactType::Tiering || type == CompactType::Fifo) {
+            return type;
+        }
+    }
+    return std::nullopt;
+}
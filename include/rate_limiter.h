@@ -0,0 +1,157 @@
+#pragma once
+
+#include "options.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/*
+flush和compaction共享的写入带宽限制(令牌桶, 单位为写入的entry数)
+- 令牌按rate持续补充, 最多积累refill_period内的量
+- High(flush): 不等待, 只扣除令牌, 使之后的compaction让出带宽; flush慢会直接导致写入阻塞
+- Low(compaction): 扣除令牌后等待直到令牌不再为负(包括High扣除的部分)
+- 自动调整: compaction债务越多, rate越高(最多max_multiplier倍), 避免限速导致写入停止
+*/
+
+enum class IOPriority {
+    Low,
+    High,
+    Count
+};
+
+/**
+ * @brief 每个优先级请求的entry数和等待时间
+ */
+struct RateLimiterStats {
+    std::array<std::size_t, static_cast<std::size_t>(IOPriority::Count)> entries{};
+    std::array<std::chrono::nanoseconds, static_cast<std::size_t>(IOPriority::Count)> wait_time{};
+
+    std::size_t get_entries(IOPriority priority) const { return entries[static_cast<std::size_t>(priority)]; }
+    std::chrono::nanoseconds get_wait_time(IOPriority priority) const {
+        return wait_time[static_cast<std::size_t>(priority)];
+    }
+};
+
+class RateLimiter {
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // 配置的每秒entry数, 0表示不限制
+    std::size_t base_rate;
+    // 自动调整后实际使用的每秒entry数
+    double rate;
+    double tokens = 0;
+    Clock::time_point last_refill = Clock::now();
+    Clock::time_point start_time = Clock::now();
+    RateLimiterStats stats;
+    // 令牌最多积累的时间
+    std::chrono::milliseconds refill_period = CONFIG::RATE_LIMIT_REFILL_PERIOD;
+    bool auto_tune_enabled = CONFIG::RATE_LIMIT_AUTO_TUNE;
+    std::size_t max_multiplier = CONFIG::RATE_LIMIT_MAX_MULTIPLIER;
+    // 每有这么多的compaction债务, 自动调整增加一倍配置的速率
+    std::size_t debt_per_multiplier = CONFIG::SOFT_PENDING_COMPACTION_ENTRIES;
+
+    void refill() {
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill).count();
+        double burst = rate * std::chrono::duration<double>(refill_period).count();
+        tokens = std::min(tokens + elapsed * rate, burst);
+        last_refill = now;
+    }
+
+    bool unlimited() const { return base_rate == 0; }
+
+  public:
+    explicit RateLimiter(std::size_t entries_per_sec = CONFIG::RATE_LIMIT_ENTRIES_PER_SEC)
+        : base_rate(entries_per_sec), rate(static_cast<double>(entries_per_sec)) {}
+
+    explicit RateLimiter(const Options &options) : RateLimiter(options.rate_limit_entries_per_sec) {
+        set_options(options);
+    }
+
+    /**
+     * @brief 按options修改速率和自动调整的参数
+     */
+    void set_options(const Options &options) {
+        set_rate(options.rate_limit_entries_per_sec);
+        std::lock_guard<std::mutex> lock(mutex);
+        refill_period = options.rate_limit_refill_period;
+        auto_tune_enabled = options.rate_limit_auto_tune;
+        max_multiplier = options.rate_limit_max_multiplier;
+        debt_per_multiplier = options.soft_pending_compaction_entries;
+    }
+
+    /**
+     * @brief 写入n个entry前(或后)调用, 按优先级等待令牌
+     */
+    void request(std::size_t n, IOPriority priority) {
+        if (n == 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        auto start = Clock::now();
+        stats.entries[static_cast<std::size_t>(priority)] += n;
+        if (unlimited()) {
+            return;
+        }
+        refill();
+        tokens -= static_cast<double>(n);
+        if (priority == IOPriority::High) {
+            return;
+        }
+        while (tokens < 0 && !unlimited()) {
+            cv.wait_for(lock, std::chrono::duration<double>(-tokens / rate));
+            refill();
+        }
+        stats.wait_time[static_cast<std::size_t>(priority)] += Clock::now() - start;
+    }
+
+    /**
+     * @brief 修改配置的速率, 0表示不限制(同时唤醒所有等待的请求)
+     */
+    void set_rate(std::size_t entries_per_sec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        refill();
+        base_rate = entries_per_sec;
+        rate = static_cast<double>(entries_per_sec);
+        cv.notify_all();
+    }
+
+    /**
+     * @brief 根据compaction债务调整速率: 每soft_pending_compaction_entries的债务增加一倍配置的速率
+     */
+    void auto_tune(std::size_t debt) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (unlimited() || !auto_tune_enabled) {
+            return;
+        }
+        refill();
+        double multiplier = 1 + static_cast<double>(debt) / std::max<std::size_t>(debt_per_multiplier, 1);
+        rate = base_rate * std::min(multiplier, static_cast<double>(max_multiplier));
+        cv.notify_all();
+    }
+
+    double get_rate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return unlimited() ? 0 : rate;
+    }
+
+    RateLimiterStats get_stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    /**
+     * @return 创建以来该优先级平均每秒写入的entry数
+     */
+    double get_throughput(IOPriority priority) {
+        std::lock_guard<std::mutex> lock(mutex);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+        return elapsed > 0 ? stats.get_entries(priority) / elapsed : 0;
+    }
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+SST内有序key数组的查找布局:
+- Binary: 直接在有序数组上二分, 每次探测都可能是一次cache miss
+- Eytzinger: 按BFS顺序(堆序)重新排列key, 前几层集中在少数cache line中, 并且可以提前prefetch后几层
+- Learned: 分段线性模型预测key的位置, 只在误差窗口内搜索(learned_index.h, 只支持数值key, 其余退化为Binary)
+*/
+enum class SearchLayout {
+    Binary,
+    Eytzinger,
+    Learned
+};
+
+/**
+ * @brief 有序数组上的lower_bound, 通用版本使用比较器(operator<)二分
+ */
+template <typename K, bool = std::is_integral_v<K> && (sizeof(K) == 4 || sizeof(K) == 8)>
+struct KeySearch {
+    static std::size_t lower_bound(const K *keys, std::size_t n, const K &key) {
+        return std::lower_bound(keys, keys + n, key) - keys;
+    }
+};
+
+/**
+ * @brief 32/64位整数key的特化: 无分支二分缩小到一个小块, 块内用SIMD一次比较多个key, 统计<key的个数即为结果
+ * @note AVX2一次比较8个int32/4个int64; 只有SSE2时一次比较4个int32/2个int64(int64用32位比较组合, SSE4.2时直接比较);
+ *       否则退化为标量循环
+ */
+template <typename K>
+struct KeySearch<K, true> {
+    // 块大小为2个cache line
+    static constexpr std::size_t BLOCK = 128 / sizeof(K);
+
+    static std::size_t lower_bound(const K *keys, std::size_t n, const K &key) {
+        const K *base = keys;
+        // 不变式: 结果在[base, base + n]中
+        while (n > BLOCK) {
+            std::size_t half = n / 2;
+            // 两个可能的下一次探测位置都预取, 掩盖比较结果出来之前的访存延迟
+            __builtin_prefetch(base + half / 2 - 1);
+            __builtin_prefetch(base + half + half / 2 - 1);
+            base = base[half - 1] < key ? base + half : base;
+            n -= half;
+        }
+        return (base - keys) + count_less(base, n, key);
+    }
+
+  private:
+    // 有符号比较指令, 无符号数翻转最高位后比较结果不变
+    static constexpr K SIGN_FLIP = std::is_signed_v<K> ? K(0) : K(K(1) << (sizeof(K) * 8 - 1));
+
+    static std::size_t count_less(const K *data, std::size_t n, K key) {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        if constexpr (sizeof(K) == 4) {
+#if defined(__AVX2__)
+            const __m256i flip = _mm256_set1_epi32(static_cast<int>(SIGN_FLIP));
+            const __m256i k = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), flip);
+            for (; i + 8 <= n; i += 8) {
+                __m256i d = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), flip);
+                count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, d))));
+            }
+#elif defined(__SSE2__)
+            const __m128i flip = _mm_set1_epi32(static_cast<int>(SIGN_FLIP));
+            const __m128i k = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), flip);
+            for (; i + 4 <= n; i += 4) {
+                __m128i d = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), flip);
+                count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, d))));
+            }
+#endif
+        } else {
+#if defined(__AVX2__)
+            const __m256i flip = _mm256_set1_epi64x(static_cast<long long>(SIGN_FLIP));
+            const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), flip);
+            for (; i + 4 <= n; i += 4) {
+                __m256i d = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), flip);
+                count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, d))));
+            }
+#elif defined(__SSE4_2__)
+            const __m128i flip = _mm_set1_epi64x(static_cast<long long>(SIGN_FLIP));
+            const __m128i k = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), flip);
+            for (; i + 2 <= n; i += 2) {
+                __m128i d = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), flip);
+                count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, d))));
+            }
+#elif defined(__SSE2__)
+            // 没有64位比较: 高32位有符号比较, 相等时看低32位的无符号比较(翻转符号位后有符号比较);
+            // movemask_pd只取每个64位的最高位, 即高32位的结果
+            const __m128i flip = _mm_xor_si128(
+                _mm_set1_epi64x(static_cast<long long>(SIGN_FLIP)), _mm_set1_epi64x(0x80000000LL)
+            );
+            const __m128i k = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), flip);
+            for (; i + 2 <= n; i += 2) {
+                __m128i d = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), flip);
+                __m128i gt = _mm_cmpgt_epi32(k, d);
+                __m128i lo_gt = _mm_slli_epi64(gt, 32);
+                __m128i less = _mm_or_si128(gt, _mm_and_si128(_mm_cmpeq_epi32(k, d), lo_gt));
+                count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(less)));
+            }
+#endif
+        }
+        for (; i < n; ++i) {
+            count += data[i] < key;
+        }
+        return count;
+    }
+};
+
+/**
+ * @brief 有序key数组的Eytzinger(BFS)布局, SST创建时构建一次, 之后只读
+ */
+template <typename K>
+class EytzingerIndex {
+    static constexpr std::size_t PREFETCH_STRIDE = sizeof(K) < 64 ? 64 / sizeof(K) : 1;
+
+    // 1-based, tree[0]不使用
+    std::vector<K> tree;
+    // tree中的位置 -> 原有序数组中的下标(一个SST不会超过2^32个key)
+    std::vector<std::uint32_t> rank;
+
+    // 中序遍历有序数组, 依次填入BFS位置k
+    std::size_t build(const K *sorted, std::size_t i, std::size_t k) {
+        if (k <= size()) {
+            i = build(sorted, i, 2 * k);
+            tree[k] = sorted[i];
+            rank[k] = static_cast<std::uint32_t>(i++);
+            i = build(sorted, i, 2 * k + 1);
+        }
+        return i;
+    }
+
+  public:
+    EytzingerIndex() = default;
+
+    /**
+     * @param sorted 有序数组[sorted, sorted + n), 返回的下标相对于sorted
+     */
+    EytzingerIndex(const K *sorted, std::size_t n) : tree(n + 1), rank(n + 1) {
+        build(sorted, 0, 1);
+    }
+
+    bool empty() const { return tree.size() <= 1; }
+    std::size_t size() const { return empty() ? 0 : tree.size() - 1; }
+
+    /**
+     * @return 第一个>=key的元素在原有序数组中的下标, 不存在则返回size()
+     */
+    std::size_t lower_bound(const K &key) const {
+        std::size_t k = descend(key);
+        return k == 0 ? size() : rank[k];
+    }
+
+    /**
+     * @return 等于key的元素在原有序数组中的下标, 不存在则返回size(); 直接比较树节点, 省去一次对原数组的访问
+     */
+    std::size_t find(const K &key) const {
+        std::size_t k = descend(key);
+        return k == 0 || key < tree[k] ? size() : rank[k];
+    }
+
+    std::size_t memory_usage() const {
+        return tree.capacity() * sizeof(K) + rank.capacity() * sizeof(std::uint32_t);
+    }
+
+  private:
+    // @return 第一个>=key的节点在tree中的位置, 不存在则返回0
+    std::size_t descend(const K &key) const {
+        const std::size_t n = size();
+        std::size_t k = 1;
+        while (k <= n) {
+            if constexpr (std::is_trivially_copyable_v<K>) {
+                // 提前预取几层之后的子树(恰好占满一个cache line), 越界的预取无副作用
+                __builtin_prefetch(tree.data() + k * PREFETCH_STRIDE);
+            }
+            k = 2 * k + (tree[k] < key);
+        }
+        // 去掉最后连续的右转(末尾的1)以及最后一次左转, 得到答案所在节点
+        return k >> __builtin_ffsll(~k);
+    }
+};
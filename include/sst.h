@@ -1,13 +1,28 @@
 #pragma once
 
+#include "compaction_filter.h"
 #include "config.h"
+#include "filter.h"
+#include "learned_index.h"
 #include "log.h"
 #include "mem_table.h"
+#include "merge_operator.h"
+#include "options.h"
+#include "search.h"
+#include "stored_value.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
+#include <functional>
+#include <limits>
 #include <list>
 #include <map>
 #include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 #include <optional>
 
@@ -15,12 +30,53 @@
 SST要满足:
 - 支持范围查询
 - 能够快速得知是否包含某个Key
+
+key/value以有序数组存放(SST创建后不可变), 查找在有序数组上进行;
+可选在创建时为每个分区额外构建一份Eytzinger布局或分段线性模型(Options::search_layout), 减少大分区点查的cache miss;
+整数key在有序数组上查找时使用KeySearch的SIMD特化;
+索引和filter(Bloom/Xor, 由SST所在的Level决定)按Options::sst_partition_entries个key分区: 顶层索引只保存每个分区的第一个key,
+一次点查只会访问顶层索引 + 一个分区的filter和key块, 不会因为SST很大而触及整个索引/filter;
+设置了PrefixExtractor时额外为所有key的前缀构建一个prefix filter, 前缀查询可以直接跳过不含该前缀的SST;
+数值key可选构建RangeFilter(Options::range_filter_bits_per_key), 短范围查询可以跳过区间内没有key的SST;
+输入足够大时merge/merge_split按采样得到的边界把key空间分为Options::subcompactions个区间, 每个区间由一个线程归并;
+构建和合并SST的参数都来自调用者传入的Options(所在LSM的配置), 不传时使用CONFIG的当前值
 */
+
+/**
+ * @brief 从key中提取前缀; 要求前缀本身<=所有带该前缀的key, 且带同一前缀的key在key顺序上连续(如字符串的前N个字符)
+ */
+template <typename K>
+using PrefixExtractor = std::function<K(const K &)>;
+
 template <typename K, typename V>
 class SST {
-    // 删除操作是插入一个std::nullopt
-    std::map<K, std::optional<V>> table;
+    // 按key升序; 删除操作是插入一个std::nullopt
+    std::vector<K> keys;
+    std::vector<std::optional<V>> values;
     std::size_t max_size;
+    // 每个分区一个, 只在分区内查找; SearchLayout::Eytzinger时才构建
+    std::vector<EytzingerIndex<K>> eytzingers;
+    // 每个分区一个, 只有数值key且SearchLayout::Learned时才构建
+    std::vector<std::conditional_t<std::is_arithmetic_v<K>, PiecewiseLinearIndex<K>, std::monostate>> learned;
+    // 每个分区的key数, 不分区时为整个SST的大小
+    std::size_t partition_size = 0;
+    // 顶层索引: 每个分区的第一个key
+    std::vector<K> partition_keys;
+    // 每个分区一个filter, Bloom且bloom_bits_per_key为0时为空
+    std::vector<Filter> filters;
+    // 构建filter使用的类型, 移动到其他层时需要与该层一致
+    FilterType filter_type = CONFIG::filter_type;
+    // 所有key的前缀的filter, 没有PrefixExtractor时为空
+    std::optional<Filter> prefix_filter;
+    // 只有数值key才会构建
+    std::conditional_t<std::is_arithmetic_v<K>, RangeFilter<K>, std::monostate> range_filter;
+    std::chrono::nanoseconds filter_build_time{0};
+    // key和value的字节数(EntrySize), 用于按字节统计写放大
+    std::size_t data_size = 0;
+    // 所有entry中最晚的过期时间, 有不过期的entry(包括删除标记)时为NEVER_EXPIRE; 过期后整个SST不需要读取
+    std::int64_t max_expire_at = NEVER_EXPIRE;
+    // 创建时间(now_millis), FIFO compaction据此判断SST是否过期
+    std::int64_t creation_time = now_millis();
 
     SST(const SST&) = delete;
     SST& operator=(const SST&) = delete;
@@ -30,7 +86,24 @@ class SST {
   public:
     explicit SST(std::size_t max_size = CONFIG::NUM_SST_ENTRY) : max_size(max_size) {}
 
-    explicit SST(const MemTable<K, V>& memtable, std::size_t max_size = CONFIG::NUM_SST_ENTRY) : table(memtable.get_table()), max_size(max_size) {}
+    /**
+     * @param memtable MemTable或接口相同的类型(见policy.h), 按get_table()的顺序(key升序)读取
+     */
+    template <typename Table, typename = decltype(std::declval<const Table&>().get_table())>
+    explicit SST(
+        const Table& memtable, std::size_t max_size = CONFIG::NUM_SST_ENTRY,
+        FilterType filter_type = CONFIG::filter_type, const PrefixExtractor<K>& prefix_extractor = nullptr,
+        const Options& options = Options()
+    )
+        : max_size(max_size) {
+        keys.reserve(memtable.size());
+        values.reserve(memtable.size());
+        for (const auto& [key, value] : memtable.get_table()) {
+            keys.push_back(key);
+            values.push_back(value);
+        }
+        build_index(filter_type, prefix_extractor, options);
+    }
 
     SST(SST&&) = default;
     SST& operator=(SST&&) = default;
@@ -39,52 +112,491 @@ class SST {
         this->max_size = max_size;
     }
 
-    void set(const K &key, const std::optional<V> &value) {
-        LOG_TRACE("key={}, value={}", key, value);
-        table[key] = value;
+    /**
+     * @return 第一个>=key的位置, 不存在则返回size(); 点查和范围查询的seek共用
+     */
+    std::size_t seek(const K &key) const {
+        std::size_t partition = find_partition(key);
+        if (partition == partition_keys.size()) {
+            return 0;
+        }
+        return seek_in_partition(partition, key);
+    }
+
+    /**
+     * @return 等于key的位置, 不存在则返回size()
+     */
+    std::size_t find(const K &key) const {
+        std::size_t partition = find_partition(key);
+        if (partition == partition_keys.size()) {
+            return keys.size();
+        }
+        if (!filters.empty() && !filters[partition].may_contain(key_hash(key))) {
+            LOG_TRACE("key={}, filtered by partition {}", key, partition);
+            return keys.size();
+        }
+        if (!eytzingers.empty()) {
+            std::size_t pos = eytzingers[partition].find(key);
+            return pos < eytzingers[partition].size() ? partition * partition_size + pos : keys.size();
+        }
+        std::size_t pos = seek_in_partition(partition, key);
+        return pos < keys.size() && !(key < keys[pos]) ? pos : keys.size();
+    }
+
+    /**
+     * @return filter认为key可能存在(没有filter时总是true)
+     */
+    bool may_contain(const K &key) const {
+        std::size_t partition = find_partition(key);
+        if (partition == partition_keys.size()) {
+            return false;
+        }
+        return filters.empty() || filters[partition].may_contain(key_hash(key));
+    }
+
+    /**
+     * @return 可能存在以prefix为前缀的key(没有prefix filter时只能根据key范围判断)
+     */
+    bool may_contain_prefix(const K &prefix) const {
+        if (keys.empty() || keys.back() < prefix) {
+            return false;
+        }
+        return !prefix_filter.has_value() || prefix_filter->may_contain(key_hash(prefix));
+    }
+
+    /**
+     * @return [start, end)中可能有key(没有range filter时只能根据key范围判断)
+     */
+    bool may_contain_range(const K &start, const K &end) const {
+        if (keys.empty() || keys.back() < start || !(keys.front() < end)) {
+            return false;
+        }
+        if constexpr (std::is_arithmetic_v<K>) {
+            if (!range_filter.empty()) {
+                return range_filter.may_contain_range(start, end);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 从第一个>=start的key开始按顺序访问entry, 直到in_range(key)为false
+     * @param result 已经存在的key(来自更新的数据)不会被覆盖, 已经存在的merge operand由merger与该SST中的版本合并
+     * @return 访问到的entry数
+     */
+    template <typename InRange>
+    std::size_t scan(
+        const K &start, InRange &&in_range, std::map<K, std::optional<V>> &result,
+        const VersionMerger<V> &merger = nullptr
+    ) const {
+        std::size_t count = 0;
+        for (std::size_t pos = seek(start); pos < keys.size() && in_range(keys[pos]); ++pos, ++count) {
+            add_older_version(result, keys[pos], values[pos], merger);
+        }
+        return count;
     }
 
     std::optional<V> get(const K &key) const {
-        auto it = table.find(key);
-        if (it != table.end()) {
-            LOG_TRACE("key={}, found value={}", key, it->second);
-            return it->second;
+        std::size_t pos = find(key);
+        if (pos < keys.size()) {
+            LOG_TRACE("key={}, found value={}", key, values[pos]);
+            return values[pos];
         }
         LOG_TRACE("key={}, not found", key);
         return std::nullopt;
     }
 
-    std::size_t size() const { return table.size(); }
+    // SearchLayout::Learned时分区的模型(段数/内存/误差)
+    const auto& get_learned_index(std::size_t partition) const { return learned[partition]; }
+    std::size_t get_partition_count() const { return partition_keys.size(); }
+
+    std::chrono::nanoseconds get_filter_build_time() const { return filter_build_time; }
+    std::size_t get_data_size() const { return data_size; }
+    std::int64_t get_max_expire_at() const { return max_expire_at; }
+    bool is_expired(std::int64_t now) const { return max_expire_at <= now; }
+    FilterType get_filter_type() const { return filter_type; }
+    std::int64_t get_creation_time() const { return creation_time; }
+
+    std::size_t filter_memory_usage() const {
+        std::size_t bytes = prefix_filter.has_value() ? prefix_filter->memory_usage() : 0;
+        if constexpr (std::is_arithmetic_v<K>) {
+            bytes += range_filter.memory_usage();
+        }
+        for (const auto& filter : filters) {
+            bytes += filter.memory_usage();
+        }
+        return bytes;
+    }
+
+    const K& key_at(std::size_t pos) const { return keys[pos]; }
+    const std::optional<V>& value_at(std::size_t pos) const { return values[pos]; }
+
+    std::size_t size() const { return keys.size(); }
     std::size_t get_max_size() const { return max_size; }
-    bool is_full() const { return table.size() >= max_size; }
-    bool empty() const { return table.empty(); }
+    bool is_full() const { return keys.size() >= max_size; }
+    bool empty() const { return keys.empty(); }
 
     std::pair<K, K> get_key_range() const {
-        return {table.begin()->first, table.rbegin()->first};
+        return {keys.front(), keys.back()};
+    }
+
+    /**
+     * @return 是否含有删除标记或merge operand(合并入最后一层时需要重写才能丢弃/合并为value)
+     */
+    bool has_tombstones_or_operands() const {
+        return std::any_of(values.begin(), values.end(), [](const std::optional<V>& value) {
+            return !value.has_value() || is_merge_operand(value);
+        });
     }
 
     bool contains_key(const K& key) const {
-        return table.find(key) != table.end();
+        return find(key) < keys.size();
     }
 
-    static SST<K, V> merge(std::list<SST<K, V>> ssts) {
-        std::priority_queue<std::pair<K, std::optional<V>>, std::vector<std::pair<K, std::optional<V>>>, std::greater<>> min_heap;
+    /**
+     * @brief 合并多个SST为一个
+     * @param ssts 从旧到新排列, 相同的key只保留最新的(最新的是merge operand时由merger与更旧的版本合并)
+     * @param drop_tombstones 没有更旧的数据时(合并入最后一层)可以丢弃删除标记
+     * @param compaction_filter 每个输出的key/value经过该filter
+     */
+    static SST<K, V> merge(
+        std::list<SST<K, V>> ssts, FilterType filter_type = CONFIG::filter_type,
+        const PrefixExtractor<K>& prefix_extractor = nullptr, bool drop_tombstones = false,
+        const VersionMerger<V>& merger = nullptr, const CompactionFilter<K, V>& compaction_filter = nullptr,
+        const Options& options = Options()
+    ) {
+        std::size_t total = 0;
         for (const auto& sst : ssts) {
-            for (const auto& [key, value] : sst.table) {
-                min_heap.emplace(key, value);
-            }
+            total += sst.size();
         }
-        // TODO
-        SST<K, V> merged(min_heap.size());
-        while (!min_heap.empty()) {
-            const auto& top = min_heap.top();
-            const K& key = top.first;
-            const std::optional<V>& value = top.second;
-            merged.set(key, value);
-            min_heap.pop();
+        SST<K, V> merged(total);
+        merged.keys.reserve(total);
+        merged.values.reserve(total);
+        std::vector<K> boundaries = sample_boundaries(ssts, total, options);
+        if (boundaries.empty()) {
+            merge_entries(
+                ssts, drop_tombstones, merger, compaction_filter,
+                [&](const K& key, const std::optional<V>& value) {
+                    merged.keys.push_back(key);
+                    merged.values.push_back(value);
+                }
+            );
+        } else {
+            // 每个区间归并到自己的数组, 全部完成后按区间顺序拼接
+            std::vector<SST<K, V>> parts(boundaries.size() + 1);
+            run_subcompactions(boundaries, [&](std::size_t i, const K* lower, const K* upper) {
+                merge_entries(
+                    ssts, drop_tombstones, merger, compaction_filter,
+                    [&](const K& key, const std::optional<V>& value) {
+                        parts[i].keys.push_back(key);
+                        parts[i].values.push_back(value);
+                    },
+                    lower, upper
+                );
+            });
+            for (auto& part : parts) {
+                merged.keys.insert(merged.keys.end(), part.keys.begin(), part.keys.end());
+                merged.values.insert(merged.values.end(), part.values.begin(), part.values.end());
+            }
         }
+        merged.build_index(filter_type, prefix_extractor, options);
         return merged;
     }
+
+    /**
+     * @brief 合并多个SST, 结果按key切分为每个最多file_entries个key的SST(key范围互不重叠, 按key升序)
+     * @param ssts 从旧到新排列, 相同的key只保留最新的(最新的是merge operand时由merger与更旧的版本合并)
+     * @param drop_tombstones 没有更旧的数据时(合并入最后一层)可以丢弃删除标记
+     * @param compaction_filter 每个输出的key/value经过该filter
+     */
+    static std::list<SST<K, V>> merge_split(
+        std::list<SST<K, V>> ssts, std::size_t file_entries, FilterType filter_type = CONFIG::filter_type,
+        const PrefixExtractor<K>& prefix_extractor = nullptr, bool drop_tombstones = false,
+        const VersionMerger<V>& merger = nullptr, const CompactionFilter<K, V>& compaction_filter = nullptr,
+        const Options& options = Options()
+    ) {
+        std::size_t total = 0;
+        for (const auto& sst : ssts) {
+            total += sst.size();
+        }
+        std::vector<K> boundaries = sample_boundaries(ssts, total, options);
+        // 每个区间输出自己的SST(包括filter和索引的构建), 全部完成后一次性按区间顺序拼接
+        std::vector<std::list<SST<K, V>>> range_outputs(boundaries.size() + 1);
+        auto merge_range = [&](std::size_t i, const K* lower, const K* upper) {
+            auto& outputs = range_outputs[i];
+            auto finish = [&]() {
+                outputs.back().build_index(filter_type, prefix_extractor, options);
+            };
+            merge_entries(
+                ssts, drop_tombstones, merger, compaction_filter,
+                [&](const K& key, const std::optional<V>& value) {
+                    if (outputs.empty() || outputs.back().size() >= file_entries) {
+                        if (!outputs.empty()) {
+                            finish();
+                        }
+                        outputs.emplace_back(file_entries);
+                        outputs.back().keys.reserve(file_entries);
+                        outputs.back().values.reserve(file_entries);
+                    }
+                    outputs.back().keys.push_back(key);
+                    outputs.back().values.push_back(value);
+                },
+                lower, upper
+            );
+            if (!outputs.empty()) {
+                finish();
+            }
+        };
+        if (boundaries.empty()) {
+            merge_range(0, nullptr, nullptr);
+        } else {
+            run_subcompactions(boundaries, merge_range);
+        }
+        std::list<SST<K, V>> outputs;
+        for (auto& range_output : range_outputs) {
+            outputs.splice(outputs.end(), range_output);
+        }
+        return outputs;
+    }
+
+    /**
+     * @brief 复制sst中位置在[first, last)的entry为一个新的SST, 用于只合并一个key子区间, sst本身不变
+     */
+    static SST<K, V> slice(
+        const SST<K, V>& sst, std::size_t first, std::size_t last, FilterType filter_type = CONFIG::filter_type,
+        const PrefixExtractor<K>& prefix_extractor = nullptr, const Options& options = Options()
+    ) {
+        SST<K, V> sliced(last - first);
+        sliced.keys.assign(sst.keys.begin() + first, sst.keys.begin() + last);
+        sliced.values.assign(sst.values.begin() + first, sst.values.begin() + last);
+        sliced.build_index(filter_type, prefix_extractor, options);
+        return sliced;
+    }
+
+    /**
+     * @brief 输入不少于Options::subcompaction_min_entries时, 从所有输入中按相同间隔采样key(大的SST采样多),
+     *        取分位点作为子compaction的边界
+     * @return 升序且互不相同的边界, 最多Options::subcompactions-1个; 为空表示不拆分
+     */
+    static std::vector<K> sample_boundaries(const std::list<SST<K, V>>& ssts, std::size_t total, const Options& options) {
+        std::size_t num_ranges = options.subcompactions;
+        if (num_ranges <= 1 || total < std::max<std::size_t>(options.subcompaction_min_entries, 1)) {
+            return {};
+        }
+        std::size_t step = std::max<std::size_t>(total / (num_ranges * 32), 1);
+        std::vector<K> samples;
+        for (const auto& sst : ssts) {
+            for (std::size_t pos = 0; pos < sst.size(); pos += step) {
+                samples.push_back(sst.keys[pos]);
+            }
+        }
+        std::sort(samples.begin(), samples.end());
+        std::vector<K> boundaries;
+        for (std::size_t i = 1; i < num_ranges; ++i) {
+            const K& key = samples[i * samples.size() / num_ranges];
+            if (boundaries.empty() || boundaries.back() < key) {
+                boundaries.push_back(key);
+            }
+        }
+        return boundaries;
+    }
+
+  private:
+    /**
+     * @brief boundaries把key空间分为boundaries.size()+1个区间, 每个区间由一个线程调用run(i, lower, upper)
+     * @details 第i个区间为[lower, upper), nullptr表示无界; 返回时所有区间都已完成
+     */
+    template <typename Run>
+    static void run_subcompactions(const std::vector<K>& boundaries, Run&& run) {
+        std::vector<std::thread> threads;
+        threads.reserve(boundaries.size());
+        for (std::size_t i = 0; i < boundaries.size(); ++i) {
+            const K* lower = i == 0 ? nullptr : &boundaries[i - 1];
+            threads.emplace_back([&run, i, lower, upper = &boundaries[i]]() { run(i, lower, upper); });
+        }
+        // 最后一个区间在当前线程执行
+        run(boundaries.size(), &boundaries.back(), nullptr);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief 多路归并, 按key升序对每个key调用一次emit(key, value)
+     * @param ssts 从旧到新排列, 相同的key只保留最新的; 最新的是merge operand时依次与更旧的版本合并,
+     *             直到得到完整的value; drop_tombstones时没有更旧的版本, 剩下的operand本身就是value
+     * @param compaction_filter 合并后的value(不包括删除标记和merge operand)输出前经过该filter,
+     *                          Remove时输出删除标记(drop_tombstones时不输出)
+     * @param lower, upper 只归并[lower, upper)中的key, nullptr表示无界
+     */
+    template <typename Emit>
+    static void merge_entries(
+        const std::list<SST<K, V>>& ssts, bool drop_tombstones, const VersionMerger<V>& merger,
+        const CompactionFilter<K, V>& compaction_filter, Emit&& emit, const K* lower = nullptr,
+        const K* upper = nullptr
+    ) {
+        struct Cursor {
+            const SST<K, V>* sst;
+            // ssts中的下标, 越大越新
+            std::size_t source;
+            std::size_t pos;
+            std::size_t end;
+            const K& key() const { return sst->keys[pos]; }
+        };
+        // 堆顶为key最小的游标, key相同时为最新的
+        auto lower_priority = [](const Cursor& a, const Cursor& b) {
+            if (b.key() < a.key()) {
+                return true;
+            }
+            if (a.key() < b.key()) {
+                return false;
+            }
+            return a.source < b.source;
+        };
+        std::priority_queue<Cursor, std::vector<Cursor>, decltype(lower_priority)> heap(lower_priority);
+        std::size_t source = 0;
+        for (const auto& sst : ssts) {
+            std::size_t pos = lower == nullptr ? 0 : sst.seek(*lower);
+            std::size_t end = upper == nullptr ? sst.size() : sst.seek(*upper);
+            if (pos < end) {
+                heap.push({&sst, source, pos, end});
+            }
+            ++source;
+        }
+        // 当前key要输出的版本: 指向SST中最新的版本, 合并过merge operand时指向merged
+        const K* last_key = nullptr;
+        const std::optional<V>* current = nullptr;
+        std::optional<V> merged;
+        const std::optional<V> tombstone;
+        auto finish_key = [&]() {
+            if (drop_tombstones && merger && is_merge_operand(*current)) {
+                merged = merger(std::nullopt, **current);
+                current = &merged;
+            }
+            if (compaction_filter && current->has_value() && !is_merge_operand(*current)) {
+                V new_value{};
+                FilterDecision decision = compaction_filter(*last_key, **current, new_value);
+                if (decision == FilterDecision::Remove) {
+                    current = &tombstone;
+                } else if (decision == FilterDecision::ChangeValue) {
+                    merged = std::move(new_value);
+                    current = &merged;
+                }
+            }
+            if (!drop_tombstones || current->has_value()) {
+                emit(*last_key, *current);
+            }
+        };
+        while (!heap.empty()) {
+            Cursor cursor = heap.top();
+            heap.pop();
+            const std::optional<V>& value = cursor.sst->values[cursor.pos];
+            if (last_key == nullptr || *last_key < cursor.key()) {
+                if (last_key != nullptr) {
+                    finish_key();
+                }
+                last_key = &cursor.key();
+                current = &value;
+            } else if (merger && is_merge_operand(*current)) {
+                merged = merger(value, **current);
+                current = &merged;
+            }
+            if (++cursor.pos < cursor.end) {
+                heap.push(cursor);
+            }
+        }
+        if (last_key != nullptr) {
+            finish_key();
+        }
+    }
+
+    /**
+     * @return key所在的分区(最后一个第一个key<=key的分区), key小于所有key时返回partition_keys.size()
+     */
+    std::size_t find_partition(const K &key) const {
+        std::size_t partition = KeySearch<K>::lower_bound(partition_keys.data(), partition_keys.size(), key);
+        if (partition < partition_keys.size() && !(key < partition_keys[partition])) {
+            return partition;
+        }
+        return partition == 0 ? partition_keys.size() : partition - 1;
+    }
+
+    // 只在一个分区的key块内查找(有该分区的Eytzinger布局或learned index时使用它们); 分区内都<key时结果恰为下一个分区的起点
+    std::size_t seek_in_partition(std::size_t partition, const K &key) const {
+        std::size_t first = partition * partition_size;
+        if (!eytzingers.empty()) {
+            return first + eytzingers[partition].lower_bound(key);
+        }
+        if constexpr (std::is_arithmetic_v<K>) {
+            if (!learned.empty()) {
+                return first + learned[partition].lower_bound(keys.data() + first, key);
+            }
+        }
+        std::size_t last = std::min(first + partition_size, keys.size());
+        return first + KeySearch<K>::lower_bound(keys.data() + first, last - first, key);
+    }
+
+    void build_index(FilterType filter_type, const PrefixExtractor<K>& prefix_extractor, const Options& options) {
+        this->filter_type = filter_type;
+        data_size = 0;
+        max_expire_at = keys.empty() ? NEVER_EXPIRE : std::numeric_limits<std::int64_t>::min();
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            data_size += entry_size(keys[i]) + entry_size(values[i]);
+            std::int64_t expire_at = values[i].has_value() ? ExpiryTraits<V>::expire_at(*values[i]) : NEVER_EXPIRE;
+            max_expire_at = std::max(max_expire_at, expire_at);
+        }
+        partition_size = options.sst_partition_entries == 0 ? keys.size() : options.sst_partition_entries;
+        partition_keys.clear();
+        filters.clear();
+        eytzingers.clear();
+        learned.clear();
+        bool build_filter = filter_type != FilterType::Bloom || options.bloom_bits_per_key > 0;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::uint64_t> hashes;
+        for (std::size_t first = 0; first < keys.size(); first += partition_size) {
+            std::size_t last = std::min(first + partition_size, keys.size());
+            partition_keys.push_back(keys[first]);
+            if (build_filter) {
+                hashes.clear();
+                for (std::size_t i = first; i < last; ++i) {
+                    hashes.push_back(key_hash(keys[i]));
+                }
+                filters.emplace_back(filter_type, hashes, options.bloom_bits_per_key);
+            }
+        }
+        if (prefix_extractor) {
+            // key有序, 带同一前缀的key连续, 相邻去重即可
+            hashes.clear();
+            std::optional<K> last_prefix;
+            for (const K& key : keys) {
+                K prefix = prefix_extractor(key);
+                if (!last_prefix.has_value() || *last_prefix != prefix) {
+                    hashes.push_back(key_hash(prefix));
+                    last_prefix = std::move(prefix);
+                }
+            }
+            prefix_filter.emplace(filter_type, hashes, std::max<std::size_t>(options.bloom_bits_per_key, 1));
+        }
+
+        if constexpr (std::is_arithmetic_v<K>) {
+            if (options.range_filter_bits_per_key > 0) {
+                range_filter = RangeFilter<K>(keys, options.range_filter_bits_per_key);
+            }
+        }
+        filter_build_time = std::chrono::steady_clock::now() - start;
+
+        for (std::size_t first = 0; first < keys.size(); first += partition_size) {
+            std::size_t n = std::min(partition_size, keys.size() - first);
+            if (options.search_layout == SearchLayout::Eytzinger) {
+                eytzingers.emplace_back(keys.data() + first, n);
+            } else if (options.search_layout == SearchLayout::Learned) {
+                if constexpr (std::is_arithmetic_v<K>) {
+                    learned.emplace_back(keys.data() + first, n, options.learned_index_epsilon);
+                    LOG_DEBUG("SST partition with {} keys built learned index {}", n, learned.back());
+                }
+            }
+        }
+    }
 };
 
 
@@ -93,7 +605,20 @@ struct fmt::formatter<SST<K, V>> : fmt::formatter<std::string_view> {
     template <typename FormatContext>
     auto format(const SST<K, V>& sst, FormatContext& ctx) const {
         auto out = ctx.out();
-        out = fmt::format_to(out, "SST{{size: {}, max_size: {}}}", sst.size(), sst.get_max_size());
+        out = fmt::format_to(
+            out, "SST{{size: {}, max_size: {}, partitions: {}, filter_bytes: {}", sst.size(), sst.get_max_size(),
+            sst.get_partition_count(), sst.filter_memory_usage()
+        );
+        if constexpr (std::is_arithmetic_v<K>) {
+            std::size_t segments = 0;
+            for (const auto& index : sst.learned) {
+                segments += index.segment_count();
+            }
+            if (segments > 0) {
+                out = fmt::format_to(out, ", learned_segments: {}", segments);
+            }
+        }
+        out = fmt::format_to(out, "}}");
         return out;
     }
 };
\ No newline at end of file
@@ -1,79 +1,334 @@
 #pragma once
 
 #include "level.h"
-#include "config.h"
+#include "options.h"
+#include "policy.h"
 
 #include "fmt/format.h"
+#include <algorithm>
 #include <cmath>
+#include <map>
 #include <optional>
 #include <vector>
 
-template <typename K, typename V>
+template <typename K, typename V, typename Policy = DefaultPolicy>
 class LevelStorage {
-    std::vector<Level<K, V>> levels;
+    // 各层通过指针读取, LevelStorage构造后不能移动
+    Options options;
+    std::vector<Level<K, V, Policy>> levels;
 
-    friend class fmt::formatter<LevelStorage<K, V>>;
+    friend class fmt::formatter<LevelStorage<K, V, Policy>>;
 
   public:
-    explicit LevelStorage(std::size_t num_levels = CONFIG::NUM_LEVELS) {
+    /**
+     * @param options compact_type决定整体的compaction策略, 各层实际使用的策略由get_compact_type_for_level决定;
+     *                Policy固定的选项覆盖options中的值
+     */
+    explicit LevelStorage(Options options = Options(), const PrefixExtractor<K> &prefix_extractor = nullptr)
+        : options(apply_policy<Policy>(std::move(options))) {
+        ASSERT_FATAL(this->options.is_valid());
+        const std::size_t num_levels = this->options.num_levels;
+        const CompactType compact_type = compact_type_of<Policy>(this->options);
         for (ssize_t i = num_levels - 1; i >= 0; --i) {
-            ssize_t max_ssts = get_max_ssts_for_level(i);
-            Level<K, V> level(i, max_ssts);
+            bool is_last = static_cast<std::size_t>(i) == num_levels - 1;
+            ssize_t max_ssts = get_max_ssts_for_level(i, is_last);
+            Level<K, V, Policy> level(
+                &this->options, i, get_compact_type_for_level(i, is_last), max_ssts, get_max_entries_for_level(i),
+                get_filter_type_for_level(i)
+            );
             levels.insert(levels.begin(), std::move(level));
         }
         for (size_t i = 0; i < levels.size() - 1; ++i) {
             levels[i].set_next_level(&levels[i + 1]);
         }
+        if (compact_type == CompactType::Universal) {
+            // L0的run直接合并入最后一层的有序run
+            levels[0].set_next_level(&levels.back());
+        }
+        if (compact_type == CompactType::Fifo) {
+            // 只使用L0
+            levels[0].set_next_level(nullptr);
+        }
+        for (auto &level : levels) {
+            level.set_prefix_extractor(prefix_extractor);
+        }
         // LOG_INFO("LevelStorage initialized: {}", *this);
         for (const auto &level : levels) {
             LOG_INFO("LevelStorage initialized: {}", level);
         }
     }
 
-    void add_sst_to_l0(SST<K, V> sst) {
-        levels[0].add_sst(std::move(sst));
+    /**
+     * @param compact 为false时只加入L0, 由之后的compact_once进行compaction
+     */
+    void add_sst_to_l0(SST<K, V> sst, bool compact = true) {
+        drop_expired_ssts();
+        if (options.dynamic_level_entries && compact_type_of<Policy>(options) == CompactType::Leveling) {
+            update_dynamic_level_targets();
+        }
+        if (compact) {
+            levels[0].add_sst(std::move(sst));
+        } else {
+            levels[0].push_sst(std::move(sst));
+        }
+    }
+
+    /**
+     * @brief 删除所有entry都已过期且不遮挡更旧数据的SST, 之后的compaction不需要读取它们
+     */
+    void drop_expired_ssts() {
+        std::int64_t now = now_millis();
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            levels[i].drop_expired_ssts(now, [&](const K &smallest, const K &largest) {
+                return std::any_of(levels.begin() + i + 1, levels.end(), [&](const Level<K, V, Policy> &level) {
+                    return level.overlaps(smallest, largest);
+                });
+            });
+        }
+    }
+
+    bool needs_compaction() const {
+        return std::any_of(levels.begin(), levels.end(), [](const Level<K, V, Policy> &level) {
+            return level.needs_compaction();
+        });
+    }
+
+    /**
+     * @brief 对最上面需要compaction的层执行一次compaction(下层因此需要的compaction会级联完成)
+     * @return 是否执行了compaction
+     */
+    bool compact_once() {
+        for (auto &level : levels) {
+            if (level.needs_compaction()) {
+                level.compact();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 所有层还需要被compaction重写的entry数之和
+    std::size_t get_compaction_debt() const {
+        std::size_t debt = 0;
+        for (const auto &level : levels) {
+            debt += level.get_compaction_debt();
+        }
+        return debt;
     }
 
+    /**
+     * @brief 运行时修改配置: 按新的配置重新计算各层的容量和filter类型, 之后的flush/compaction生效
+     * @details options的compact_type和num_levels必须与当前的相同
+     */
+    void set_options(const Options &new_options) {
+        ASSERT_FATAL(new_options.compact_type == options.compact_type && new_options.num_levels == options.num_levels);
+        ASSERT_FATAL(new_options.is_valid());
+        options = apply_policy<Policy>(new_options);
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            bool is_last = i == levels.size() - 1;
+            levels[i].set_max_ssts(get_max_ssts_for_level(i, is_last));
+            levels[i].set_max_entries(get_max_entries_for_level(i));
+            levels[i].set_filter_type(get_filter_type_for_level(i));
+        }
+        if (compact_type_of<Policy>(options) == CompactType::Leveling && levels.size() > 1) {
+            if (options.dynamic_level_entries) {
+                update_dynamic_level_targets();
+            } else {
+                levels[0].set_next_level(&levels[1]);
+            }
+        }
+    }
+
+    const Options &get_options() const { return options; }
+
     std::optional<V> get(const K &key) const {
         std::optional<V> result;
+        get(key, result);
+        return result;
+    }
+
+    /**
+     * @brief 从L0到Lmax查找key, 见Level::get
+     * @param result 更新的数据(MemTable)中已经找到的merge operand, 返回时为合并后的结果(可能仍是merge operand)
+     */
+    bool get(const K &key, std::optional<V> &result) const {
         for (const auto &level : levels) {
-            result = level.get(key);
-            if (result.has_value()) {
+            if (level.get(key, result)) {
                 LOG_DEBUG("key={}, found in level {}", key, level.get_level_num());
-                return result;
+                return true;
             }
         }
-        return std::nullopt;
+        return false;
+    }
+
+    /**
+     * @brief 从L0到Lmax查找key的第一个不是merge operand的版本, 见Level::get_base
+     */
+    bool get_base(const K &key, std::optional<V> &base) const {
+        for (const auto &level : levels) {
+            if (level.get_base(key, base)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void set_version_merger(const VersionMerger<V> &version_merger) {
+        for (auto &level : levels) {
+            level.set_version_merger(version_merger);
+        }
+    }
+
+    void set_compaction_filter(const CompactionFilter<K, V> &compaction_filter) {
+        for (auto &level : levels) {
+            level.set_compaction_filter(compaction_filter);
+        }
+    }
+
+    /**
+     * @brief 从L0到Lmax(从新到旧)收集从start开始满足in_range的entry, 已有的(更新的)key不会被覆盖
+     */
+    template <typename InRange, typename Skip>
+    void scan(const K &start, InRange &&in_range, Skip &&skip, std::map<K, std::optional<V>> &result) const {
+        for (const auto &level : levels) {
+            level.scan(start, in_range, skip, result);
+        }
+    }
+
+    /**
+     * @brief 所有层的统计之和
+     */
+    LevelStats get_stats() const {
+        LevelStats total;
+        for (const auto &level : levels) {
+            const LevelStats &stats = level.get_stats();
+            total.compactions += stats.compactions;
+            total.split_compactions += stats.split_compactions;
+            total.ssts_written += stats.ssts_written;
+            total.entries_written += stats.entries_written;
+            total.bytes_written += stats.bytes_written;
+            total.filter_build_time += stats.filter_build_time;
+            total.trivial_moves += stats.trivial_moves;
+            total.ssts_deleted += stats.ssts_deleted;
+            total.entries_deleted += stats.entries_deleted;
+        }
+        return total;
+    }
+
+    ScanStats get_scan_stats() const {
+        ScanStats total;
+        for (const auto &level : levels) {
+            total.ssts_scanned += level.get_scan_stats().ssts_scanned;
+            total.ssts_skipped += level.get_scan_stats().ssts_skipped;
+            total.ssts_false_positive += level.get_scan_stats().ssts_false_positive;
+        }
+        return total;
     }
 
-    Level<K, V> &operator[](std::size_t index) { return levels[index]; }
-    const Level<K, V> &operator[](std::size_t index) const { return levels[index]; }
+    Level<K, V, Policy> &operator[](std::size_t index) { return levels[index]; }
+    const Level<K, V, Policy> &operator[](std::size_t index) const { return levels[index]; }
     std::size_t size() const { return levels.size(); }
 
-    friend std::ostream& operator<<(std::ostream& os, const LevelStorage<K, V>& level_storage) {
+    friend std::ostream& operator<<(std::ostream& os, const LevelStorage& level_storage) {
         return os << fmt::format("{}", level_storage);
     }
 
   private:
-    std::size_t get_max_ssts_for_level(std::size_t level) const {
+    /**
+     * @brief 根据最后一层的实际大小从下往上推导每层的容量(每层为下一层的1/NUM_LEVEL_MULTI)
+     * @details 推导出的容量不足L1默认容量的层不再使用: L0直接compact到第一个使用的层(base level),
+     *          base level之上残留的数据容量为0, 会逐步下推. 这样约90%的数据在最后一层, 空间放大约为1.1倍
+     */
+    void update_dynamic_level_targets() {
+        if (levels.size() <= 2) {
+            return;
+        }
+        const std::size_t last = levels.size() - 1;
+        const std::size_t base_entries = get_max_entries_for_level(1);
+        std::size_t target = std::max(levels[last].get_entry_count(), base_entries);
+        std::size_t base_level = last;
+        while (base_level > 1 && target / level_multi_of<Policy>(options) >= base_entries) {
+            target /= level_multi_of<Policy>(options);
+            --base_level;
+            levels[base_level].set_max_entries(target);
+        }
+        for (std::size_t i = 1; i < base_level; ++i) {
+            levels[i].set_max_entries(0);
+        }
+        // base level下移时, 它上面的层中还有更旧的数据: L0先compact到其中最上面的非空层,
+        // 这些层容量为0, 逐步下推清空后再下移, 保证更新的数据总在更旧的数据之上
+        std::size_t l0_target = base_level;
+        for (std::size_t i = 1; i < base_level; ++i) {
+            if (levels[i].get_entry_count() > 0) {
+                l0_target = i;
+                break;
+            }
+        }
+        if (levels[0].get_next_level() != &levels[l0_target]) {
+            LOG_INFO("base level changed to L{}", l0_target);
+            levels[0].set_next_level(&levels[l0_target]);
+        }
+    }
+
+    FilterType get_filter_type_for_level(std::size_t level) const {
+        if constexpr (Policy::filter_type.has_value()) {
+            return *Policy::filter_type;
+        }
+        if (level < options.level_filter_types.size()) {
+            return options.level_filter_types[level];
+        }
+        return options.filter_type;
+    }
+
+    // Leveling下L1+的容量: L1为L0满时的entry数的level_multi倍, 之后每层再乘level_multi
+    std::size_t get_max_entries_for_level(std::size_t level) const {
+        return options.max_l0_ssts * options.mem_entries * std::pow(level_multi_of<Policy>(options), level);
+    }
+
+    // LazyLeveling下按层决定合并策略: 最后一层Z=1时为Leveling, 其余为Tiering
+    // Universal下L0选择run合并, 最后一层为Leveling的有序run, 中间层不使用
+    CompactType get_compact_type_for_level(std::size_t level, bool is_last) const {
+        const CompactType compact_type = compact_type_of<Policy>(options);
+        if (compact_type == CompactType::LazyLeveling) {
+            return is_last && options.last_level_runs <= 1 ? CompactType::Leveling : CompactType::Tiering;
+        }
+        if (compact_type == CompactType::Fifo) {
+            return CompactType::Fifo;
+        }
+        if (compact_type == CompactType::Universal) {
+            if (level == 0) {
+                return CompactType::Universal;
+            }
+            return is_last ? CompactType::Leveling : CompactType::Tiering;
+        }
+        return compact_type;
+    }
+
+    std::size_t get_max_ssts_for_level(std::size_t level, bool is_last) const {
+        const CompactType compact_type = compact_type_of<Policy>(options);
         if (level == 0)
-            return CONFIG::NUM_MAX_L0_SST;
+            return compact_type == CompactType::Universal ? options.universal_max_runs : options.max_l0_ssts;
 
-        switch (CONFIG::compact_type) {
+        switch (compact_type) {
             case CompactType::Leveling:
                 return 1;
             case CompactType::Tiering:
-                return CONFIG::NUM_MAX_L0_SST * std::pow(CONFIG::NUM_LEVEL_MULTI, level);
+                return options.max_l0_ssts * std::pow(level_multi_of<Policy>(options), level);
+            case CompactType::LazyLeveling:
+                return is_last ? options.last_level_runs : options.upper_level_runs;
+            case CompactType::Universal:
+            case CompactType::Fifo:
+                return 1;
             default:
                 return 0;
         }
     }
 };
 
-template <typename K, typename V>
-struct fmt::formatter<LevelStorage<K, V>> : fmt::formatter<std::string_view> {
+template <typename K, typename V, typename Policy>
+struct fmt::formatter<LevelStorage<K, V, Policy>> : fmt::formatter<std::string_view> {
     template <typename FormatContext>
-    auto format(const LevelStorage<K, V>& level_storage, FormatContext& ctx) const {
+    auto format(const LevelStorage<K, V, Policy>& level_storage, FormatContext& ctx) const {
         return fmt::format_to(ctx.out(), "LevelStorage{{levels: [{}]}}", fmt::join(level_storage.levels, ", "));
     }
 };
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "fmt/format.h"
+#include "merge_operator.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <variant>
+
+// now_millis的时间来源, 为空时使用system_clock; 测试可以替换为手动推进的时钟
+inline std::function<std::int64_t()> millis_source;
+
+/**
+ * @brief 当前时间, system_clock的毫秒数; 过期时间, 写入时间和SST的创建时间都以此表示
+ */
+inline std::int64_t now_millis() {
+    if (millis_source) {
+        return millis_source();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// 不过期的entry(以及包含这样的entry的SST)的过期时间
+inline constexpr std::int64_t NEVER_EXPIRE = std::numeric_limits<std::int64_t>::max();
+
+/**
+ * @brief 大value分离后在blob文件中的位置
+ */
+struct BlobIndex {
+    std::uint64_t file_number = 0;
+    // 文件中第几条记录
+    std::uint64_t offset = 0;
+    // value的字节数
+    std::size_t size = 0;
+
+    bool operator==(const BlobIndex &other) const {
+        return file_number == other.file_number && offset == other.offset;
+    }
+    bool operator!=(const BlobIndex &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief LSM::merge写入的还没有合并到value上的operand(可能已经由多个operand合并而来)
+ */
+template <typename V>
+struct MergeOperand {
+    V value;
+};
+
+/**
+ * @brief LSM内部(MemTable/SST)保存的value: value本身, value分离到blob文件后的BlobIndex, 或merge operand
+ */
+template <typename V>
+class StoredValue {
+    std::variant<V, BlobIndex, MergeOperand<V>> value;
+    // set_with_ttl写入的entry的过期时间(now_millis), 读取时已过期的entry视为不存在
+    std::int64_t expire_at = NEVER_EXPIRE;
+
+  public:
+    StoredValue() = default;
+    StoredValue(V value, std::int64_t expire_at = NEVER_EXPIRE) : value(std::move(value)), expire_at(expire_at) {}
+    StoredValue(BlobIndex index, std::int64_t expire_at = NEVER_EXPIRE) : value(index), expire_at(expire_at) {}
+    StoredValue(MergeOperand<V> operand) : value(std::move(operand)) {}
+
+    std::int64_t get_expire_at() const { return expire_at; }
+    bool is_expired(std::int64_t now) const { return expire_at <= now; }
+    bool is_blob() const { return std::holds_alternative<BlobIndex>(value); }
+    bool is_operand() const { return std::holds_alternative<MergeOperand<V>>(value); }
+    const V &get_value() const { return std::get<V>(value); }
+    const BlobIndex &get_blob_index() const { return std::get<BlobIndex>(value); }
+    const V &get_operand() const { return std::get<MergeOperand<V>>(value).value; }
+};
+
+template <typename V>
+struct MergeOperandTraits<StoredValue<V>> {
+    static bool is_operand(const StoredValue<V> &value) { return value.is_operand(); }
+};
+
+/**
+ * @brief entry的过期时间, SST据此记录其中最晚的过期时间; 只有StoredValue可以过期
+ */
+template <typename T>
+struct ExpiryTraits {
+    static std::int64_t expire_at(const T &) { return NEVER_EXPIRE; }
+};
+
+template <typename V>
+struct ExpiryTraits<StoredValue<V>> {
+    static std::int64_t expire_at(const StoredValue<V> &value) { return value.get_expire_at(); }
+};
+
+/**
+ * @brief 一个key/value在SST中占用的字节数: 有size()的容器(如std::string)为元素的字节数, 其他类型为sizeof
+ */
+template <typename T, typename = void>
+struct EntrySize {
+    static std::size_t size(const T &) { return sizeof(T); }
+};
+
+template <typename T>
+struct EntrySize<T, std::void_t<decltype(std::declval<const T &>().size()), typename T::value_type>> {
+    static std::size_t size(const T &value) { return value.size() * sizeof(typename T::value_type); }
+};
+
+template <typename T>
+struct EntrySize<std::optional<T>> {
+    static std::size_t size(const std::optional<T> &value) { return value.has_value() ? EntrySize<T>::size(*value) : 0; }
+};
+
+template <typename V>
+struct EntrySize<StoredValue<V>> {
+    static std::size_t size(const StoredValue<V> &value) {
+        if (value.is_blob()) {
+            return sizeof(BlobIndex);
+        }
+        return EntrySize<V>::size(value.is_operand() ? value.get_operand() : value.get_value());
+    }
+};
+
+template <typename T>
+std::size_t entry_size(const T &value) {
+    return EntrySize<T>::size(value);
+}
+
+template <>
+struct fmt::formatter<BlobIndex> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const BlobIndex &index, FormatContext &ctx) const {
+        return fmt::format_to(ctx.out(), "blob{{file: {}, offset: {}, size: {}}}", index.file_number, index.offset, index.size);
+    }
+};
+
+template <typename V>
+struct fmt::formatter<StoredValue<V>> : fmt::formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(const StoredValue<V> &value, FormatContext &ctx) const {
+        if (value.is_blob()) {
+            return fmt::format_to(ctx.out(), "{}", value.get_blob_index());
+        }
+        if (value.is_operand()) {
+            return fmt::format_to(ctx.out(), "merge{{{}}}", value.get_operand());
+        }
+        return fmt::format_to(ctx.out(), "{}", value.get_value());
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "column_family.h"
+#include "stored_value.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 一组写入, 由LSM::write原子地应用: 读取要么看到全部写入, 要么一个都看不到; 可以跨column family
+ */
+template <typename K, typename V>
+class WriteBatch {
+  public:
+    enum class Type {
+        Put,
+        Merge
+    };
+
+    struct Op {
+        ColumnFamilyHandle column_family;
+        Type type;
+        K key;
+        V value;
+        // Put的过期时间
+        std::int64_t expire_at = NEVER_EXPIRE;
+    };
+
+    void set(ColumnFamilyHandle column_family, const K &key, const V &value) {
+        ops.push_back({column_family, Type::Put, key, value});
+    }
+
+    // 过期时间从加入batch时开始计算
+    void set_with_ttl(ColumnFamilyHandle column_family, const K &key, const V &value, std::chrono::milliseconds ttl) {
+        ops.push_back({column_family, Type::Put, key, value, now_millis() + ttl.count()});
+    }
+
+    void merge(ColumnFamilyHandle column_family, const K &key, const V &operand) {
+        ops.push_back({column_family, Type::Merge, key, operand});
+    }
+
+    const std::vector<Op> &get_ops() const { return ops; }
+    std::size_t size() const { return ops.size(); }
+    bool empty() const { return ops.empty(); }
+    void clear() { ops.clear(); }
+
+  private:
+    std::vector<Op> ops;
+};
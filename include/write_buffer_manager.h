@@ -0,0 +1,87 @@
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/*
+多个LSM共享的MemTable内存上限: 每个LSM(client)在每次写入后上报自己所有MemTable(包括Immutable MemTable)的字节数,
+总数超过上限时, 由正在写入且用量不低于平均值的LSM提前刷出自己最大的MemTable.
+LSM之间不互相flush(需要持有对方的锁); 空闲的LSM不再增长, 其余LSM在用量达到平均值后开始刷出, 总用量保持在上限附近
+*/
+class WriteBufferManager {
+    mutable std::mutex mutex;
+    // 0表示不限制
+    std::size_t buffer_size;
+    std::size_t memory_usage = 0;
+    std::size_t clients = 0;
+    // 因超过上限而提前flush的次数
+    std::size_t flush_count = 0;
+
+  public:
+    explicit WriteBufferManager(std::size_t buffer_size = CONFIG::WRITE_BUFFER_SIZE) : buffer_size(buffer_size) {}
+
+    /**
+     * @brief 进程内默认共享的实例, 上限为首次使用时的CONFIG::WRITE_BUFFER_SIZE
+     */
+    static const std::shared_ptr<WriteBufferManager> &global() {
+        static const std::shared_ptr<WriteBufferManager> manager = std::make_shared<WriteBufferManager>();
+        return manager;
+    }
+
+    void add_client() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++clients;
+    }
+
+    // usage为该client最后上报的字节数
+    void remove_client(std::size_t usage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        --clients;
+        memory_usage -= usage;
+    }
+
+    /**
+     * @brief client的用量从old_usage变为new_usage
+     */
+    void update(std::size_t old_usage, std::size_t new_usage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        memory_usage = memory_usage - old_usage + new_usage;
+    }
+
+    /**
+     * @return 总用量超过上限, 并且用量为client_usage的client应当刷出一个MemTable
+     */
+    bool should_flush(std::size_t client_usage) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return buffer_size > 0 && memory_usage > buffer_size && client_usage > 0 &&
+               client_usage * clients >= memory_usage;
+    }
+
+    void record_flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++flush_count;
+    }
+
+    void set_buffer_size(std::size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer_size = size;
+    }
+
+    std::size_t get_buffer_size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return buffer_size;
+    }
+
+    std::size_t get_memory_usage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return memory_usage;
+    }
+
+    std::size_t get_flush_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return flush_count;
+    }
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "options.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+/*
+写入控制: 根据L0的SST数和compaction债务(还需要被compaction重写的entry数)决定每次写入前是否等待
+- 正常: 不等待
+- 减速: 超过slowdown阈值后, 每次写入等待的时间随超出的比例线性增加, 最多max_write_delay;
+  后台compaction借此追上写入, 避免债务一直增长到stop阈值
+- 停止: 达到stop阈值后写入阻塞, 直到compaction使其回到stop阈值以下
+L0的SST数和债务只在flush/compaction之后变化, 所以只在这时调用update, 每次写入只读取结果
+*/
+
+enum class StallCause {
+    None,
+    // L0的SST数达到l0_slowdown_ssts
+    L0Slowdown,
+    // compaction债务达到soft_pending_compaction_entries
+    DebtSlowdown,
+    // L0的SST数达到l0_stop_ssts
+    L0Stop,
+    // compaction债务达到hard_pending_compaction_entries
+    DebtStop,
+    Count
+};
+
+/**
+ * @brief 按原因统计被延迟/阻塞的写入数和等待时间
+ */
+struct StallStats {
+    std::array<std::size_t, static_cast<std::size_t>(StallCause::Count)> writes{};
+    std::array<std::chrono::nanoseconds, static_cast<std::size_t>(StallCause::Count)> time{};
+
+    std::size_t get_writes(StallCause cause) const { return writes[static_cast<std::size_t>(cause)]; }
+    std::chrono::nanoseconds get_time(StallCause cause) const { return time[static_cast<std::size_t>(cause)]; }
+
+    std::size_t total_writes() const {
+        std::size_t total = 0;
+        for (std::size_t count : writes) {
+            total += count;
+        }
+        return total;
+    }
+
+    std::chrono::nanoseconds total_time() const {
+        std::chrono::nanoseconds total{0};
+        for (auto t : time) {
+            total += t;
+        }
+        return total;
+    }
+};
+
+class WriteController {
+    StallCause cause = StallCause::None;
+    // 减速时超出slowdown阈值的比例, (0, 1)
+    double ratio = 0;
+    StallStats stats;
+    std::size_t l0_slowdown_ssts;
+    std::size_t l0_stop_ssts;
+    std::size_t soft_pending_compaction_entries;
+    std::size_t hard_pending_compaction_entries;
+    std::chrono::microseconds max_write_delay;
+
+    // value在[slowdown, stop)中的位置, 刚达到slowdown时也大于0
+    static double excess(std::size_t value, std::size_t slowdown, std::size_t stop) {
+        if (value < slowdown) {
+            return 0;
+        }
+        return static_cast<double>(value - slowdown + 1) / static_cast<double>(stop - slowdown + 1);
+    }
+
+  public:
+    explicit WriteController(const Options &options = Options()) { set_options(options); }
+
+    // 新的阈值在下一次update时生效
+    void set_options(const Options &options) {
+        l0_slowdown_ssts = options.l0_slowdown_ssts;
+        l0_stop_ssts = options.l0_stop_ssts;
+        soft_pending_compaction_entries = options.soft_pending_compaction_entries;
+        hard_pending_compaction_entries = options.hard_pending_compaction_entries;
+        max_write_delay = options.max_write_delay;
+    }
+
+    void update(std::size_t l0_ssts, std::size_t debt) {
+        if (l0_ssts >= l0_stop_ssts) {
+            cause = StallCause::L0Stop;
+        } else if (debt >= hard_pending_compaction_entries) {
+            cause = StallCause::DebtStop;
+        } else {
+            double l0_ratio = excess(l0_ssts, l0_slowdown_ssts, l0_stop_ssts);
+            double debt_ratio = excess(debt, soft_pending_compaction_entries, hard_pending_compaction_entries);
+            ratio = std::max(l0_ratio, debt_ratio);
+            if (ratio == 0) {
+                cause = StallCause::None;
+            } else {
+                cause = l0_ratio >= debt_ratio ? StallCause::L0Slowdown : StallCause::DebtSlowdown;
+            }
+        }
+    }
+
+    StallCause get_cause() const { return cause; }
+    bool is_stopped() const { return cause == StallCause::L0Stop || cause == StallCause::DebtStop; }
+
+    /**
+     * @return 减速时每次写入前需要等待的时间
+     */
+    std::chrono::microseconds get_delay() const {
+        if (cause != StallCause::L0Slowdown && cause != StallCause::DebtSlowdown) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(max_write_delay * ratio);
+    }
+
+    void record(StallCause cause, std::chrono::nanoseconds time) {
+        ++stats.writes[static_cast<std::size_t>(cause)];
+        stats.time[static_cast<std::size_t>(cause)] += time;
+    }
+
+    const StallStats& get_stats() const { return stats; }
+};
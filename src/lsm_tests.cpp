@@ -2,7 +2,50 @@
 #include "log.h"
 #include "lsm.h"
 #include <config.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <random>
 #include <string>
+#include <utility>
+
+/**
+ * @brief 修改CONFIG中的一个选项(或其他全局设置), 析构时恢复原值; ASSERT_*失败提前返回时也不会影响之后的测试
+ */
+template <typename T>
+class ConfigGuard {
+    T &option;
+    T old_value;
+
+  public:
+    explicit ConfigGuard(T &option) : option(option), old_value(option) {}
+    template <typename U>
+    ConfigGuard(T &option, U &&value) : ConfigGuard(option) {
+        option = std::forward<U>(value);
+    }
+    ~ConfigGuard() { option = std::move(old_value); }
+
+    ConfigGuard(const ConfigGuard &) = delete;
+    ConfigGuard &operator=(const ConfigGuard &) = delete;
+};
+
+template <typename T>
+ConfigGuard(T &) -> ConfigGuard<T>;
+template <typename T, typename U>
+ConfigGuard(T &, U &&) -> ConfigGuard<T>;
+
+/**
+ * @brief 替换now_millis的手动时钟, 只由advance推进; TTL相关的测试不依赖sleep和线程调度
+ */
+class ManualClock {
+    std::int64_t now = now_millis();
+    ConfigGuard<std::function<std::int64_t()>> guard;
+
+  public:
+    ManualClock() : guard(millis_source, [this] { return now; }) {}
+
+    void advance(std::chrono::milliseconds duration) { now += duration.count(); }
+};
 
 TEST(LSMTest, Basic) {
     LSM<int, std::string> lsm;
@@ -82,6 +125,1197 @@ TEST(LSMTest, UpdateBasic) {
     EXPECT_EQ(r3.value(), "value3");
 }
 
+TEST(LSMTest, Scan) {
+    LSM<int, int> lsm;
+    for (int i = 0; i < 1000; ++i) {
+        lsm.set(i, i);
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        lsm.set(i, -i);
+    }
+
+    auto result = lsm.scan(100, 200);
+    ASSERT_EQ(result.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(result[i].first, 100 + i);
+        EXPECT_EQ(result[i].second, (100 + i) % 3 == 0 ? -(100 + i) : 100 + i);
+    }
+    EXPECT_TRUE(lsm.scan(1000, 2000).empty());
+    EXPECT_EQ(lsm.scan(-10, 1).size(), 1u);
+}
+
+TEST(LSMTest, PrefixScan) {
+    LSM<std::string, int> lsm([](const std::string &key) { return key.substr(0, 4); });
+    // 每个前缀的key连续写入, 不同前缀落在不同的SST中
+    for (int p = 0; p < 50; ++p) {
+        for (int i = 0; i < 20; ++i) {
+            lsm.set(fmt::format("p{:03}:{:03}", p, i), p * 100 + i);
+        }
+    }
+
+    auto result = lsm.prefix_scan("p017");
+    ASSERT_EQ(result.size(), 20u);
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(result[i].first, fmt::format("p017:{:03}", i));
+        EXPECT_EQ(result[i].second, 1700 + i);
+    }
+    EXPECT_TRUE(lsm.prefix_scan("p999").empty());
+
+    auto stats = lsm.get_levels().get_scan_stats();
+    EXPECT_GT(stats.ssts_skipped, stats.ssts_scanned);
+}
+
+TEST(LSMTest, RangeFilter) {
+    ConfigGuard bits_guard(CONFIG::RANGE_FILTER_BITS_PER_KEY, 8);
+
+    // key间隔1000, 长度100的区间大多为空
+    LSM<int64_t, int> lsm;
+    std::mt19937_64 rng(3);
+    std::vector<int64_t> keys;
+    for (int i = 0; i < 2000; ++i) {
+        keys.push_back(static_cast<int64_t>(rng() % 2000) * 1000);
+        lsm.set(keys.back(), i);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (int i = 0; i < 2000; ++i) {
+        int64_t start = static_cast<int64_t>(rng() % 2000000);
+        bool expected_empty = std::lower_bound(keys.begin(), keys.end(), start) == std::lower_bound(keys.begin(), keys.end(), start + 100);
+        ASSERT_EQ(lsm.empty_range(start, start + 100), expected_empty) << "start=" << start;
+    }
+
+    const auto &levels = lsm.get_levels();
+    auto stats = levels.get_scan_stats();
+    EXPECT_GT(stats.ssts_skipped, 0u);
+    EXPECT_LT(stats.false_positive_rate(), 0.2);
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        EXPECT_LE(levels[i].get_scan_stats().false_positive_rate(), 1.0);
+    }
+}
+
+TEST(LSMTest, LevelingPartialCompaction) {
+    ConfigGuard type_guard(CONFIG::compact_type, CompactType::Leveling);
+
+    LSM<int, int> lsm;
+    std::map<int, int> expected;
+    std::mt19937 rng(11);
+    for (int i = 0; i < 50000; ++i) {
+        int key = static_cast<int>(rng() % 20000);
+        lsm.set(key, i);
+        expected[key] = i;
+    }
+    for (const auto &[key, value] : expected) {
+        ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+    }
+    auto result = lsm.scan(0, 20000);
+    ASSERT_EQ(result.size(), expected.size());
+    EXPECT_TRUE(std::equal(result.begin(), result.end(), expected.begin(), [](const auto &a, const auto &b) {
+        return a.first == b.first && a.second == b.second;
+    }));
+
+    // L1+: SST按key升序, 互不重叠, 不超过NUM_FILE_ENTRY
+    const auto &levels = lsm.get_levels();
+    for (std::size_t i = 1; i < levels.size(); ++i) {
+        const auto &ssts = levels[i].get_ssts();
+        for (auto it = ssts.begin(); it != ssts.end(); ++it) {
+            EXPECT_LE(it->size(), CONFIG::NUM_FILE_ENTRY);
+            if (std::next(it) != ssts.end()) {
+                EXPECT_LT(it->get_key_range().second, std::next(it)->get_key_range().first);
+            }
+        }
+    }
+    // 只重写重叠的文件, 每层的写放大约为NUM_LEVEL_MULTI量级, 而不是整层
+    auto stats = levels.get_stats();
+    EXPECT_LT(stats.entries_written, 50000u * CONFIG::NUM_LEVEL_MULTI * levels.size());
+}
+
+TEST(LSMTest, LastLevelOverflow) {
+    ConfigGuard type_guard(CONFIG::compact_type);
+    // 远超 NUM_SST_ENTRY * NUM_LEVEL_MULTI^NUM_LEVELS 的数据量
+    ConfigGuard levels_guard(CONFIG::NUM_LEVELS, 3);
+
+    for (auto type : {CompactType::Leveling, CompactType::Tiering}) {
+        CONFIG::compact_type = type;
+        LSM<int, int> lsm;
+        for (int i = 1; i <= 100000; ++i) {
+            lsm.set(i % 30000, i);
+        }
+        for (int i = 70001; i <= 100000; ++i) {
+            ASSERT_EQ(lsm.get(i % 30000), i);
+        }
+        const auto &last_level = lsm.get_levels()[CONFIG::NUM_LEVELS - 1];
+        EXPECT_GT(last_level.get_stats().compactions, 0u);
+        if (type == CompactType::Leveling) {
+            // 最后一层是一个有序run, 旧版本在合并时被丢弃
+            EXPECT_LE(last_level.get_entry_count(), 30000u);
+        }
+    }
+}
+
+TEST(LSMTest, DynamicLevelEntries) {
+    ConfigGuard type_guard(CONFIG::compact_type, CompactType::Leveling);
+    ConfigGuard dynamic_guard(CONFIG::dynamic_level_entries, true);
+
+    LSM<int, int> lsm;
+    std::mt19937 rng(5);
+    for (int i = 0; i < 200000; ++i) {
+        lsm.set(static_cast<int>(rng() % 20000), i);
+    }
+    const auto &levels = lsm.get_levels();
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        total += levels[i].get_entry_count();
+    }
+    std::size_t last = levels[levels.size() - 1].get_entry_count();
+    // 大部分数据在最后一层, 空间放大有界
+    EXPECT_GE(last * 10, total * 8);
+    EXPECT_LE(total, 20000u * 13 / 10);
+    // 小数据量下中间层不被使用
+    EXPECT_EQ(levels[1].get_entry_count(), 0u);
+    EXPECT_EQ(levels[1].get_max_entries(), 0u);
+}
+
+TEST(LSMTest, DynamicLevelBaseMovesDown) {
+    ColumnFamilyOptions<int, int> options;
+    options.compact_type = CompactType::Leveling;
+    options.dynamic_level_entries = true;
+    options.num_levels = 4;
+    ManualClock clock;
+    LSM<int, int> lsm(options);
+    for (int i = 0; i < 5000; ++i) {
+        lsm.set_with_ttl(i, 0, std::chrono::milliseconds(50));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        lsm.set(i, 1);
+    }
+    // 过期的SST被删除后最后一层变小, base level下移; 上面的层残留的旧数据不能遮挡新写入的数据
+    clock.advance(std::chrono::milliseconds(100));
+    for (int i = 0; i < 1000; ++i) {
+        lsm.set(i, 2);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(lsm.get(i), 2) << "key=" << i;
+    }
+    auto entries = lsm.scan(0, 1000);
+    ASSERT_EQ(entries.size(), 1000u);
+    EXPECT_TRUE(std::all_of(entries.begin(), entries.end(), [](const auto &entry) { return entry.second == 2; }));
+}
+
+TEST(LSMTest, LazyLeveling) {
+    ConfigGuard type_guard(CONFIG::compact_type);
+    ConfigGuard levels_guard(CONFIG::NUM_LEVELS, 4);
+
+    std::map<CompactType, std::size_t> entries_written;
+    for (auto type : {CompactType::Leveling, CompactType::Tiering, CompactType::LazyLeveling}) {
+        CONFIG::compact_type = type;
+        LSM<int, int> lsm;
+        std::map<int, int> expected;
+        std::mt19937 rng(17);
+        for (int i = 0; i < 100000; ++i) {
+            int key = static_cast<int>(rng() % 20000);
+            lsm.set(key, i);
+            expected[key] = i;
+        }
+        for (const auto &[key, value] : expected) {
+            ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+        }
+        const auto &levels = lsm.get_levels();
+        entries_written[type] = levels.get_stats().entries_written;
+        if (type == CompactType::LazyLeveling) {
+            // 上层是Tiering, 最后一层是有序run
+            EXPECT_EQ(levels[1].get_compact_type(), CompactType::Tiering);
+            EXPECT_TRUE(levels[CONFIG::NUM_LEVELS - 1].is_sorted_run());
+            EXPECT_LE(levels[CONFIG::NUM_LEVELS - 1].get_entry_count(), 20000u);
+        }
+    }
+    // 写放大介于两者之间: 上层tiering减少了重写, 最后一层仍然每次合并重叠的文件
+    EXPECT_LT(entries_written[CompactType::LazyLeveling], entries_written[CompactType::Leveling]);
+    EXPECT_LT(entries_written[CompactType::Tiering], entries_written[CompactType::LazyLeveling]);
+}
+
+TEST(LSMTest, UniversalCompaction) {
+    ConfigGuard type_guard(CONFIG::compact_type);
+    ConfigGuard incremental_guard(CONFIG::UNIVERSAL_INCREMENTAL_FILES);
+
+    std::map<std::size_t, std::size_t> entries_written;
+    // 一次写入(包括其中的flush和compaction)最多写入的entry数
+    std::map<std::size_t, std::size_t> max_step_written;
+    for (std::size_t incremental_files : {0, 4}) {
+        CONFIG::compact_type = CompactType::Universal;
+        CONFIG::UNIVERSAL_INCREMENTAL_FILES = incremental_files;
+        LSM<int, int> lsm;
+        std::map<int, int> expected;
+        std::mt19937 rng(23);
+        bool drained = false;
+        for (int i = 0; i < 100000; ++i) {
+            int key = static_cast<int>(rng() % 20000);
+            std::size_t before = lsm.get_levels().get_stats().entries_written;
+            lsm.set(key, i);
+            expected[key] = i;
+            max_step_written[incremental_files] =
+                std::max(max_step_written[incremental_files], lsm.get_levels().get_stats().entries_written - before);
+            drained |= !lsm.get_levels()[0].get_draining_ssts().empty();
+            // 合并到一半的窗口不影响读取
+            if (i % 997 == 0) {
+                ASSERT_EQ(lsm.get(key), i);
+            }
+        }
+        EXPECT_EQ(drained, incremental_files > 0);
+        for (const auto &[key, value] : expected) {
+            ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+        }
+        auto result = lsm.scan(0, 20000);
+        ASSERT_EQ(result.size(), expected.size());
+
+        const auto &levels = lsm.get_levels();
+        // L0之外只有最后一层有数据, 且是一个有序run
+        for (std::size_t i = 1; i + 1 < levels.size(); ++i) {
+            EXPECT_EQ(levels[i].get_entry_count(), 0u);
+        }
+        const auto &last_level = levels[levels.size() - 1];
+        EXPECT_TRUE(last_level.is_sorted_run());
+        EXPECT_LE(levels[0].get_sst_count(), CONFIG::UNIVERSAL_MAX_RUNS);
+        // 空间放大有界
+        EXPECT_LE(levels[0].get_entry_count() * 100, CONFIG::UNIVERSAL_MAX_SPACE_AMP_PERCENT * last_level.get_entry_count());
+        entries_written[incremental_files] = levels.get_stats().entries_written;
+    }
+
+    // 与Leveling比较写放大
+    CONFIG::compact_type = CompactType::Leveling;
+    LSM<int, int> leveling;
+    std::mt19937 rng(23);
+    for (int i = 0; i < 100000; ++i) {
+        leveling.set(static_cast<int>(rng() % 20000), i);
+    }
+    std::size_t leveling_written = leveling.get_levels().get_stats().entries_written;
+    EXPECT_LT(entries_written[0] * 2, leveling_written);
+    EXPECT_LT(entries_written[4] * 2, leveling_written);
+    // 增量模式每次flush只合并一个窗口
+    EXPECT_LT(max_step_written[4] * 2, max_step_written[0]);
+}
+
+TEST(LSMTest, UniversalIncrementalGapKeys) {
+    ColumnFamilyOptions<int, int> options;
+    options.compact_type = CompactType::Universal;
+    options.universal_incremental_files = 1;
+    // 每次L0的compaction都是空间放大compaction
+    options.universal_max_space_amp_percent = 1;
+    LSM<int, int> lsm(options);
+    for (int i = 0; i < 2000; ++i) {
+        lsm.set(i * 1000, i);
+    }
+    // 只写入落在最后一层相邻文件之间的空隙中的key, 它们也必须被轮转到
+    std::vector<int> gaps;
+    const auto &run = lsm.get_levels()[lsm.get_levels().size() - 1].get_ssts();
+    ASSERT_GT(run.size(), 2u);
+    for (auto it = run.begin(); std::next(it) != run.end(); ++it) {
+        gaps.push_back(it->get_key_range().second + 1);
+    }
+    std::map<int, int> expected;
+    for (int round = 0; round < 20; ++round) {
+        for (int gap : gaps) {
+            lsm.set(gap + round, -round);
+            expected[gap + round] = -round;
+        }
+    }
+    EXPECT_LE(lsm.get_levels()[0].get_sst_count(), options.universal_max_runs);
+    for (const auto &[key, value] : expected) {
+        ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+    }
+    EXPECT_EQ(lsm.get(1000), 1);
+
+    // 一次只合并一个run没有意义
+    Options invalid = lsm.get_options();
+    invalid.universal_min_merge_width = 1;
+    EXPECT_FALSE(lsm.set_options(invalid));
+}
+
+TEST(LSMTest, FifoCompaction) {
+    ConfigGuard type_guard(CONFIG::compact_type, CompactType::Fifo);
+    ConfigGuard max_entries_guard(CONFIG::FIFO_MAX_ENTRIES);
+    ConfigGuard ttl_guard(CONFIG::FIFO_TTL);
+
+    {
+        CONFIG::FIFO_MAX_ENTRIES = 1000;
+        LSM<int, int> lsm;
+        for (int i = 0; i < 10000; ++i) {
+            lsm.set(i, i);
+        }
+        const auto &levels = lsm.get_levels();
+        // 只有flush写入数据, 写放大为1
+        LevelStats stats = levels.get_stats();
+        EXPECT_EQ(stats.compactions, 0u);
+        EXPECT_EQ(stats.entries_written, levels[0].get_entry_count() + stats.entries_deleted);
+        EXPECT_LE(stats.entries_written, 10000u);
+        EXPECT_LE(levels[0].get_entry_count(), 1000u);
+        EXPECT_GT(stats.ssts_deleted, 0u);
+        for (std::size_t i = 1; i < levels.size(); ++i) {
+            EXPECT_EQ(levels[i].get_entry_count(), 0u);
+        }
+        // 最旧的数据被删除, 最新的数据还在
+        EXPECT_FALSE(lsm.get(0).has_value());
+        EXPECT_EQ(lsm.get(9990), 9990);
+    }
+
+    {
+        CONFIG::FIFO_MAX_ENTRIES = 0;
+        CONFIG::FIFO_TTL = std::chrono::milliseconds(50);
+        ManualClock clock;
+        LSM<int, int> lsm;
+        for (int i = 0; i < 100; ++i) {
+            lsm.set(i, i);
+        }
+        clock.advance(std::chrono::milliseconds(100));
+        for (int i = 100; i < 200; ++i) {
+            lsm.set(i, i);
+        }
+        // 过期的SST在之后的flush时被删除
+        EXPECT_FALSE(lsm.get(0).has_value());
+        EXPECT_EQ(lsm.get(199), 199);
+        EXPECT_GE(lsm.get_levels().get_stats().entries_deleted, 80u);
+    }
+}
+
+TEST(LSMTest, TrivialMove) {
+    ConfigGuard type_guard(CONFIG::compact_type, CompactType::Leveling);
+
+    LSM<int, int> lsm;
+    for (int i = 0; i < 100000; ++i) {
+        lsm.set(i, i);
+    }
+    for (int i = 0; i < 100000; i += 7) {
+        ASSERT_EQ(lsm.get(i), i);
+    }
+    LevelStats stats = lsm.get_levels().get_stats();
+    EXPECT_GT(stats.trivial_moves, 0u);
+    // 顺序写入时key范围从不重叠: 除flush和L0->L1的合并外没有重写
+    EXPECT_LT(stats.entries_written, 100000u * 21 / 10);
+
+    // flush出的SST足够大时, L0的多个输入逐个移动, 除flush外没有重写
+    ConfigGuard mem_entry_guard(CONFIG::NUM_MEM_ENTRY, CONFIG::NUM_FILE_ENTRY);
+    ConfigGuard levels_guard(CONFIG::NUM_LEVELS, 2);
+    {
+        LSM<int, int> lsm;
+        for (int i = 0; i < 10000; ++i) {
+            lsm.set(i, i);
+        }
+        stats = lsm.get_levels().get_stats();
+        EXPECT_GT(stats.trivial_moves, 10000u / CONFIG::NUM_FILE_ENTRY / 2);
+        EXPECT_LT(stats.entries_written, 10000u * 11 / 10);
+        for (const auto &sst : lsm.get_levels()[1].get_ssts()) {
+            EXPECT_EQ(sst.get_max_size(), CONFIG::NUM_FILE_ENTRY);
+        }
+    }
+    // 最后一层中的merge operand需要合并为value, 含有operand的SST不移动
+    {
+        LSM<int, int> counters(nullptr, [](const int &existing, const int &operand) { return existing + operand; });
+        for (int i = 0; i < 10000; ++i) {
+            counters.merge(i, i);
+        }
+        EXPECT_EQ(counters.get_levels().get_stats().trivial_moves, 0u);
+        for (const auto &sst : counters.get_levels()[1].get_ssts()) {
+            EXPECT_FALSE(sst.has_tombstones_or_operands());
+        }
+        for (int i = 0; i < 10000; i += 7) {
+            ASSERT_EQ(counters.get(i), i);
+        }
+    }
+}
+
+TEST(LSMTest, WriteStall) {
+    ConfigGuard slowdown_guard(CONFIG::L0_SLOWDOWN_SSTS, 4);
+    ConfigGuard stop_guard(CONFIG::L0_STOP_SSTS, 8);
+    ConfigGuard soft_guard(CONFIG::SOFT_PENDING_COMPACTION_ENTRIES, 100);
+    ConfigGuard hard_guard(CONFIG::HARD_PENDING_COMPACTION_ENTRIES, 200);
+    ConfigGuard background_guard(CONFIG::background_compaction);
+
+    // 先减速, 等待时间随积压线性增加, 最后才停止
+    WriteController controller;
+    controller.update(3, 0);
+    EXPECT_EQ(controller.get_cause(), StallCause::None);
+    EXPECT_EQ(controller.get_delay().count(), 0);
+    controller.update(4, 0);
+    EXPECT_EQ(controller.get_cause(), StallCause::L0Slowdown);
+    auto l0_delay = controller.get_delay();
+    EXPECT_GT(l0_delay.count(), 0);
+    controller.update(7, 0);
+    EXPECT_GT(controller.get_delay(), l0_delay);
+    EXPECT_LE(controller.get_delay(), CONFIG::MAX_WRITE_DELAY);
+    EXPECT_FALSE(controller.is_stopped());
+    controller.update(8, 0);
+    EXPECT_EQ(controller.get_cause(), StallCause::L0Stop);
+    EXPECT_TRUE(controller.is_stopped());
+    controller.update(0, 150);
+    EXPECT_EQ(controller.get_cause(), StallCause::DebtSlowdown);
+    controller.update(0, 200);
+    EXPECT_EQ(controller.get_cause(), StallCause::DebtStop);
+    controller.record(StallCause::L0Slowdown, std::chrono::microseconds(10));
+    controller.record(StallCause::DebtStop, std::chrono::microseconds(20));
+    EXPECT_EQ(controller.get_stats().total_writes(), 2u);
+    EXPECT_EQ(controller.get_stats().get_writes(StallCause::DebtStop), 1u);
+    EXPECT_EQ(controller.get_stats().total_time(), std::chrono::microseconds(30));
+
+    // 后台compaction下的读写
+    CONFIG::background_compaction = true;
+    CONFIG::SOFT_PENDING_COMPACTION_ENTRIES = 1 << 16;
+    CONFIG::HARD_PENDING_COMPACTION_ENTRIES = 1 << 18;
+    {
+        LSM<int, int> lsm;
+        std::map<int, int> expected;
+        std::mt19937 rng(37);
+        for (int i = 0; i < 20000; ++i) {
+            int key = static_cast<int>(rng() % 5000);
+            lsm.set(key, i);
+            expected[key] = i;
+        }
+        for (const auto &[key, value] : expected) {
+            ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+        }
+        lsm.wait_for_compaction();
+        EXPECT_FALSE(lsm.get_levels().needs_compaction());
+        EXPECT_LT(lsm.get_levels()[0].get_sst_count(), CONFIG::L0_STOP_SSTS);
+        StallStats stats = lsm.get_stall_stats();
+        EXPECT_EQ(stats.get_writes(StallCause::DebtStop), 0u);
+    }
+}
+
+TEST(LSMTest, RateLimiter) {
+    ConfigGuard background_guard(CONFIG::background_compaction);
+
+    // 在创建limiter之前计时: 令牌从创建时开始补充, 下面的下限不受调度延迟影响
+    auto start = std::chrono::steady_clock::now();
+    RateLimiter limiter(10000);
+    // flush不等待, 只扣除令牌(由等待时间的统计为0检查, 不依赖耗时)
+    limiter.request(1000, IOPriority::High);
+    // compaction需要等到High扣除的和自己的令牌都补充回来: 2000个令牌至少需要200ms
+    limiter.request(1000, IOPriority::Low);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+    RateLimiterStats stats = limiter.get_stats();
+    EXPECT_EQ(stats.get_entries(IOPriority::High), 1000u);
+    EXPECT_EQ(stats.get_entries(IOPriority::Low), 1000u);
+    EXPECT_EQ(stats.get_wait_time(IOPriority::High).count(), 0);
+    EXPECT_GT(stats.get_wait_time(IOPriority::Low).count(), 0);
+    EXPECT_GT(limiter.get_throughput(IOPriority::Low), 0);
+
+    // compaction债务增加时提高限速, 不超过上限
+    Options options;
+    options.rate_limit_entries_per_sec = 10000;
+    options.rate_limit_auto_tune = true;
+    limiter.set_options(options);
+    limiter.auto_tune(0);
+    EXPECT_DOUBLE_EQ(limiter.get_rate(), 10000);
+    limiter.auto_tune(options.soft_pending_compaction_entries);
+    EXPECT_DOUBLE_EQ(limiter.get_rate(), 20000);
+    limiter.auto_tune(options.soft_pending_compaction_entries * 100);
+    EXPECT_DOUBLE_EQ(limiter.get_rate(), 10000.0 * options.rate_limit_max_multiplier);
+
+    // 后台compaction限速下的读写
+    CONFIG::background_compaction = true;
+    {
+        LSM<int, int> lsm;
+        lsm.get_rate_limiter().set_rate(200000);
+        std::map<int, int> expected;
+        std::mt19937 rng(41);
+        for (int i = 0; i < 20000; ++i) {
+            int key = static_cast<int>(rng() % 5000);
+            lsm.set(key, i);
+            expected[key] = i;
+        }
+        lsm.wait_for_compaction();
+        for (const auto &[key, value] : expected) {
+            ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+        }
+        RateLimiterStats lsm_stats = lsm.get_rate_limiter().get_stats();
+        EXPECT_GT(lsm_stats.get_entries(IOPriority::High), 0u);
+        EXPECT_GT(lsm_stats.get_entries(IOPriority::Low), 0u);
+        EXPECT_EQ(
+            lsm_stats.get_entries(IOPriority::High) + lsm_stats.get_entries(IOPriority::Low),
+            lsm.get_levels().get_stats().entries_written
+        );
+    }
+}
+
+TEST(LSMTest, BlobSeparation) {
+    ConfigGuard threshold_guard(CONFIG::BLOB_VALUE_THRESHOLD);
+    ConfigGuard file_size_guard(CONFIG::BLOB_FILE_SIZE, 64 << 10);
+    ConfigGuard auto_gc_guard(CONFIG::blob_auto_gc, false);
+
+    auto value_of = [](int key, int version) { return std::string(1024, static_cast<char>('a' + (key + version) % 26)); };
+    auto load = [&](LSM<int, std::string> &lsm) {
+        for (int i = 0; i < 2000; ++i) {
+            lsm.set(i, value_of(i, 0));
+        }
+        return lsm.get_levels().get_stats().bytes_written;
+    };
+
+    CONFIG::BLOB_VALUE_THRESHOLD = 0;
+    LSM<int, std::string> inline_lsm;
+    std::size_t inline_bytes = load(inline_lsm);
+
+    CONFIG::BLOB_VALUE_THRESHOLD = 256;
+    LSM<int, std::string> lsm;
+    std::size_t separated_bytes = load(lsm);
+    // compaction只重写key和BlobIndex
+    EXPECT_GT(inline_bytes, separated_bytes * 10);
+    EXPECT_GT(lsm.get_blob_store().get_stats().blobs_written, 0u);
+    for (int i = 0; i < 2000; i += 13) {
+        ASSERT_EQ(lsm.get(i), value_of(i, 0));
+    }
+
+    // 覆盖大部分key后旧value成为垃圾, GC删除垃圾多的文件并搬迁其中存活的value
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 4 != 0) {
+            lsm.set(i, value_of(i, 1));
+        }
+    }
+    std::size_t before_gc = lsm.get_blob_store().get_total_bytes();
+    EXPECT_GT(lsm.garbage_collect_blobs(), 0u);
+    EXPECT_LT(lsm.get_blob_store().get_total_bytes(), before_gc);
+    EXPECT_GT(lsm.get_blob_store().get_stats().gc_bytes_reclaimed, 0u);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_EQ(lsm.get(i), value_of(i, i % 4 == 0 ? 0 : 1));
+    }
+    auto entries = lsm.scan(0, 2000);
+    ASSERT_EQ(entries.size(), 2000u);
+    EXPECT_EQ(entries[4].second, value_of(4, 0));
+    EXPECT_EQ(entries[5].second, value_of(5, 1));
+}
+
+TEST(LSMTest, BlobGarbageUnderMergeOperands) {
+    ColumnFamilyOptions<int, std::string> options;
+    options.blob_value_threshold = 64;
+    options.blob_file_size = 1024;
+    options.blob_auto_gc = false;
+    options.merge_operator = [](const std::string &existing, const std::string &operand) { return existing + operand; };
+    LSM<int, std::string> lsm(options);
+    for (int i = 0; i < 200; ++i) {
+        lsm.set(i, std::string(100, static_cast<char>('a' + i % 26)));
+    }
+    for (int i = 1000; i < 1100; ++i) {
+        lsm.set(i, "filler");
+    }
+    // merge operand叠加在分离的value上, 该value仍被读取和compaction引用
+    for (int i = 0; i < 200; ++i) {
+        lsm.merge(i, "+");
+    }
+    lsm.garbage_collect_blobs();
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_EQ(lsm.get(i), std::string(100, static_cast<char>('a' + i % 26)) + "+") << "key=" << i;
+    }
+    for (int i = 0; i < 200; ++i) {
+        lsm.merge(i, "-");
+    }
+    for (int i = 1100; i < 3000; ++i) {
+        lsm.set(i, "filler");
+    }
+    lsm.garbage_collect_blobs();
+    auto entries = lsm.scan(0, 200);
+    ASSERT_EQ(entries.size(), 200u);
+    for (const auto &[key, value] : entries) {
+        EXPECT_EQ(value, std::string(100, static_cast<char>('a' + key % 26)) + "+-");
+    }
+}
+
+TEST(LSMTest, BlobGarbageWithCompactionFilter) {
+    // 写回搬迁的value会flush并触发compaction, compaction filter读取的value可能仍在被GC的文件中
+    ColumnFamilyOptions<int, std::string> options;
+    options.compact_type = CompactType::Leveling;
+    options.mem_entries = 2;
+    options.blob_value_threshold = 64;
+    options.blob_file_size = 300;
+    options.blob_auto_gc = false;
+    options.compaction_filter = [](const int &, const std::string &, std::string &) { return FilterDecision::Keep; };
+    options.merge_operator = [](const std::string &existing, const std::string &operand) { return existing + operand; };
+    LSM<int, std::string> lsm(options);
+    auto value_of = [](int key) {
+        std::string value(100, static_cast<char>('a' + (key + key % 2) % 26));
+        return key % 3 == 0 ? value + "+" : value;
+    };
+    for (int i = 0; i < 40; ++i) {
+        lsm.set(i, std::string(100, static_cast<char>('a' + i % 26)));
+    }
+    for (int i = 0; i < 40; ++i) {
+        if (i % 2 == 1) {
+            lsm.set(i, std::string(100, static_cast<char>('a' + (i + 1) % 26)));
+        }
+        if (i % 3 == 0) {
+            lsm.merge(i, "+");
+        }
+    }
+    EXPECT_GT(lsm.garbage_collect_blobs(), 0u);
+    for (int i = 0; i < 40; ++i) {
+        ASSERT_EQ(lsm.get(i), value_of(i)) << "key=" << i;
+    }
+    // GC之后的compaction仍会遇到引用已删除文件的旧版本
+    for (int i = 40; i < 400; ++i) {
+        lsm.set(i, "filler");
+    }
+    auto entries = lsm.scan(0, 40);
+    ASSERT_EQ(entries.size(), 40u);
+    for (const auto &[key, value] : entries) {
+        EXPECT_EQ(value, value_of(key));
+    }
+}
+
+TEST(LSMTest, MergeOperator) {
+    LSM<int, int> counters(nullptr, [](const int &existing, const int &operand) { return existing + operand; });
+    std::map<int, int> expected;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 50000; ++i) {
+        int key = static_cast<int>(rng() % 500);
+        if (i % 10 == 0) {
+            counters.set(key, i);
+            expected[key] = i;
+        } else {
+            counters.merge(key, 1);
+            expected[key] += 1;
+        }
+    }
+    // operand在MemTable/SST中的各个版本都需要合并到value上
+    for (const auto &[key, value] : expected) {
+        ASSERT_EQ(counters.get(key), value);
+    }
+    auto entries = counters.scan(0, 500);
+    ASSERT_EQ(entries.size(), expected.size());
+    for (const auto &[key, value] : entries) {
+        EXPECT_EQ(value, expected[key]);
+    }
+
+    LSM<int, std::string> lists(nullptr, [](const std::string &existing, const std::string &operand) {
+        return existing + "," + operand;
+    });
+    for (int round = 0; round < 20; ++round) {
+        for (int key = 0; key < 1000; ++key) {
+            lists.merge(key, std::to_string(round));
+        }
+    }
+    EXPECT_EQ(lists.get(7), "0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19");
+    EXPECT_EQ(lists.get(999), lists.get(7));
+}
+
+TEST(LSMTest, CompactionFilter) {
+    {
+        ManualClock clock;
+        LSM<int, Timestamped<int>> lsm(nullptr, nullptr, make_ttl_filter<int, int>(std::chrono::milliseconds(50)));
+        for (int i = 0; i < 10000; ++i) {
+            lsm.set(i, Timestamped<int>::now(i));
+        }
+        clock.advance(std::chrono::milliseconds(100));
+        for (int i = 10000; i < 30000; ++i) {
+            lsm.set(i, Timestamped<int>::now(i));
+        }
+        // 之后的compaction顺带删除了过期的entry
+        std::size_t expired_left = 0;
+        for (int i = 0; i < 10000; ++i) {
+            expired_left += lsm.get(i).has_value();
+        }
+        EXPECT_LT(expired_left, 10000u / 10);
+        for (int i = 10000; i < 30000; i += 7) {
+            ASSERT_EQ(lsm.get(i)->value, i);
+        }
+    }
+
+    {
+        // 把旧格式的value改写为新格式
+        LSM<int, std::string> lsm(nullptr, nullptr, [](const int &, const std::string &value, std::string &new_value) {
+            if (value.rfind("v1:", 0) != 0) {
+                return FilterDecision::Keep;
+            }
+            new_value = "v2:" + value.substr(3);
+            return FilterDecision::ChangeValue;
+        });
+        for (int i = 0; i < 20000; ++i) {
+            lsm.set(i, "v1:" + std::to_string(i));
+        }
+        std::size_t rewritten = 0;
+        for (int i = 0; i < 20000; ++i) {
+            auto value = lsm.get(i);
+            ASSERT_TRUE(value.has_value());
+            EXPECT_EQ(value->substr(3), std::to_string(i));
+            rewritten += value->rfind("v2:", 0) == 0;
+        }
+        EXPECT_GT(rewritten, 20000u / 2);
+    }
+}
+
+TEST(LSMTest, TimeToLive) {
+    ManualClock clock;
+    LSM<int, int> lsm;
+    lsm.set(-1, 0);
+    lsm.set_with_ttl(-1, 1, std::chrono::milliseconds(50));
+    for (int i = 0; i < 20000; ++i) {
+        lsm.set_with_ttl(i, i, std::chrono::milliseconds(50));
+    }
+    EXPECT_EQ(lsm.get(-1), 1);
+    EXPECT_EQ(lsm.get(123), 123);
+
+    clock.advance(std::chrono::milliseconds(100));
+    // 过期的最新版本不会让更旧的版本重新可见
+    EXPECT_FALSE(lsm.get(-1).has_value());
+    EXPECT_FALSE(lsm.get(123).has_value());
+    EXPECT_TRUE(lsm.scan(-1, 20000).empty());
+
+    for (int i = 100000; i < 140000; ++i) {
+        lsm.set(i, i);
+    }
+    for (int i = 100000; i < 140000; i += 7) {
+        ASSERT_EQ(lsm.get(i), i);
+    }
+    EXPECT_FALSE(lsm.get(123).has_value());
+    // 全部过期的SST不经过compaction直接删除, 其余过期的entry在compaction时删除
+    LevelStats stats = lsm.get_levels().get_stats();
+    EXPECT_GT(stats.ssts_deleted, 0u);
+    std::size_t stored = 0;
+    const auto &levels = lsm.get_levels();
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        stored += levels[i].get_entry_count();
+    }
+    EXPECT_LE(stored, 40000u + 1);
+}
+
+TEST(LSMTest, ColumnFamilies) {
+    LSM<int, int> lsm;
+    auto manager = std::make_shared<WriteBufferManager>(4096);
+    lsm.set_write_buffer_manager(manager);
+    ColumnFamilyOptions<int, int> options;
+    options.compact_type = CompactType::Universal;
+    options.mem_entries = 32;
+    options.merge_operator = [](const int &existing, const int &operand) { return existing + operand; };
+    auto counters = lsm.create_column_family("counters", options);
+    auto defaults = lsm.default_column_family();
+
+    // 同一个key在不同column family中互不影响
+    for (int i = 0; i < 5000; ++i) {
+        lsm.set(i, i);
+        lsm.set(counters, i, -i);
+        ASSERT_LE(lsm.get_memtable_bytes(defaults) + lsm.get_memtable_bytes(counters), 4096u);
+    }
+    for (int i = 0; i < 5000; i += 7) {
+        ASSERT_EQ(lsm.get(i), i);
+        ASSERT_EQ(lsm.get(counters, i), -i);
+    }
+    EXPECT_EQ(lsm.scan(counters, 10, 13), (std::vector<std::pair<int, int>>{{10, -10}, {11, -11}, {12, -12}}));
+    EXPECT_GT(lsm.get_levels(counters).get_stats().entries_written, 0u);
+
+    // 一个batch跨column family写入
+    WriteBatch<int, int> batch;
+    batch.set(defaults, -1, 100);
+    batch.merge(counters, 1, 10);
+    batch.merge(counters, -1, 5);
+    batch.set(counters, 2, 20);
+    lsm.write(batch);
+    EXPECT_EQ(lsm.get(-1), 100);
+    EXPECT_EQ(lsm.get(counters, 1), 9);
+    EXPECT_EQ(lsm.get(counters, -1), 5);
+    EXPECT_EQ(lsm.get(counters, 2), 20);
+    EXPECT_EQ(lsm.get(2), 2);
+}
+
+TEST(LSMTest, WriteBufferManager) {
+    ConfigGuard mem_entry_guard(CONFIG::NUM_MEM_ENTRY, 1 << 20);
+
+    {
+        // MemTable按字节数而不是entry数写满
+        ConfigGuard mem_bytes_guard(CONFIG::MEM_TABLE_BYTES, 8192);
+        LSM<int, std::string> lsm;
+        for (int i = 0; i < 1000; ++i) {
+            lsm.set(i, std::string(i % 2 == 0 ? 16 : 1024, 'a'));
+            ASSERT_LE(lsm.get_memtable_bytes(), CONFIG::NUM_MAX_MEM_TABLE * (8192 + 1024 + 64) + 8192);
+        }
+        EXPECT_GT(lsm.get_levels().get_stats().entries_written, 0u);
+    }
+
+    // 两个LSM共享上限, 各自写满后提前flush
+    auto manager = std::make_shared<WriteBufferManager>(64 * 1024);
+    {
+        LSM<int, std::string> a;
+        LSM<int, std::string> b;
+        a.set_write_buffer_manager(manager);
+        b.set_write_buffer_manager(manager);
+        for (int i = 0; i < 2000; ++i) {
+            a.set(i, std::string(100, 'a'));
+            b.set(i, std::string(300, 'b'));
+            ASSERT_LE(manager->get_memory_usage(), 64u * 1024 + 512);
+            ASSERT_EQ(manager->get_memory_usage(), a.get_memtable_bytes() + b.get_memtable_bytes());
+        }
+        EXPECT_GT(manager->get_flush_count(), 0u);
+        for (int i = 0; i < 2000; i += 7) {
+            ASSERT_EQ(a.get(i), std::string(100, 'a'));
+            ASSERT_EQ(b.get(i), std::string(300, 'b'));
+        }
+    }
+    EXPECT_EQ(manager->get_memory_usage(), 0u);
+}
+
+TEST(LSMTest, RuntimeOptions) {
+    // 同一进程中两个配置不同的LSM
+    ColumnFamilyOptions<int, int> small;
+    small.mem_entries = 16;
+    small.max_l0_ssts = 2;
+    ColumnFamilyOptions<int, int> leveled;
+    leveled.compact_type = CompactType::Leveling;
+    leveled.mem_entries = 1024;
+    LSM<int, int> a(small);
+    LSM<int, int> b(leveled);
+    EXPECT_EQ(a.get_levels()[1].get_compact_type(), CONFIG::compact_type);
+    EXPECT_EQ(b.get_levels()[1].get_compact_type(), CompactType::Leveling);
+    for (int i = 0; i < 100; ++i) {
+        a.set(i, i);
+        b.set(i, i);
+    }
+    EXPECT_GT(a.get_levels().get_stats().entries_written, 0u);
+    EXPECT_EQ(b.get_levels().get_stats().entries_written, 0u);
+    EXPECT_EQ(a.get_options().mem_entries, 16u);
+    EXPECT_EQ(b.get_options().mem_entries, 1024u);
+
+    // 运行时修改MemTable和L0的大小
+    Options options = a.get_options();
+    options.mem_entries = 64;
+    options.max_l0_ssts = 4;
+    EXPECT_TRUE(a.set_options(options));
+    EXPECT_EQ(a.get_levels()[1].get_max_entries(), 4u * 64 * options.level_multi);
+    for (int i = 100; i < 2000; ++i) {
+        a.set(i, i);
+        ASSERT_LE(a.get_memtable_entries(), options.max_memtables * 64 + 64);
+    }
+    for (int i = 0; i < 2000; i += 7) {
+        ASSERT_EQ(a.get(i), i);
+    }
+
+    // 改变LSM结构的选项不能在运行时修改
+    options.compact_type = CompactType::Leveling;
+    EXPECT_FALSE(a.set_options(options));
+    EXPECT_EQ(a.get_options().compact_type, small.compact_type);
+}
+
+template <typename K, typename V>
+struct CountingMemTable : MemTable<K, V> {
+    static inline std::size_t created = 0;
+
+    explicit CountingMemTable(std::size_t max_size = 4, std::size_t max_bytes = 0) : MemTable<K, V>(max_size, max_bytes) {
+        ++created;
+    }
+};
+
+TEST(LSMTest, StaticPolicy) {
+    using Policy = StaticPolicy<CompactType::Leveling, FilterType::Xor, 4, CountingMemTable>;
+    // Policy固定的选项覆盖CONFIG中的默认值
+    LSM<int, int, Policy> lsm;
+    EXPECT_EQ(lsm.get_options().compact_type, CompactType::Leveling);
+    EXPECT_EQ(lsm.get_options().level_multi, 4u);
+    std::map<int, int> expected;
+    std::mt19937 rng(7);
+    for (int i = 0; i < 20000; ++i) {
+        int key = static_cast<int>(rng() % 5000);
+        lsm.set(key, i);
+        expected[key] = i;
+    }
+    for (const auto &[key, value] : expected) {
+        ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+    }
+    EXPECT_EQ(lsm.scan(0, 5000).size(), expected.size());
+    EXPECT_GT((CountingMemTable<int, StoredValue<int>>::created), 1u);
+
+    const auto &levels = lsm.get_levels();
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+        EXPECT_EQ(levels[i].get_compact_type(), CompactType::Leveling);
+        EXPECT_EQ(levels[i].get_filter_type(), FilterType::Xor);
+        for (const auto &sst : levels[i].get_ssts()) {
+            EXPECT_EQ(sst.get_filter_type(), FilterType::Xor);
+        }
+    }
+    EXPECT_TRUE(levels[1].is_sorted_run());
+
+    // set_options不能修改Policy固定的选项
+    Options options = lsm.get_options();
+    options.level_multi = 10;
+    options.mem_entries = 8;
+    EXPECT_TRUE(lsm.set_options(options));
+    EXPECT_EQ(lsm.get_options().level_multi, 4u);
+    EXPECT_EQ(lsm.get_options().mem_entries, 8u);
+    options.compact_type = CompactType::Tiering;
+    EXPECT_FALSE(lsm.set_options(options));
+}
+
+TEST(SSTTest, EytzingerLayout) {
+    ConfigGuard layout_guard(CONFIG::sst_search_layout, SearchLayout::Eytzinger);
+
+    // 分区时每个分区一个Eytzinger布局
+    for (std::size_t partition_entries : {0, 100}) {
+        ConfigGuard partition_guard(CONFIG::SST_PARTITION_ENTRY, partition_entries);
+        for (int n : {1, 2, 3, 7, 8, 100, 1023, 1024, 1025, 5000}) {
+            MemTable<int, int> mem_table(n);
+            for (int i = 0; i < n; ++i) {
+                mem_table.set(i * 2, i);
+            }
+            SST<int, int> sst(mem_table);
+            for (int key = -1; key <= n * 2; ++key) {
+                std::size_t expected = key < 0 ? 0 : std::min((key + 1) / 2, n);
+                ASSERT_EQ(sst.seek(key), expected) << "n=" << n << ", key=" << key;
+                auto result = sst.get(key);
+                ASSERT_EQ(result.has_value(), key >= 0 && key % 2 == 0 && key < n * 2);
+                if (result.has_value()) {
+                    EXPECT_EQ(result.value(), key / 2);
+                }
+            }
+        }
+    }
+
+    LSM<int, int> lsm;
+    for (int i = 1; i <= 10000; ++i) {
+        lsm.set(i, i * 100);
+    }
+    for (int i = 1; i <= 10000; ++i) {
+        auto result = lsm.get(i);
+        ASSERT_TRUE(result.has_value());
+        EXPECT_EQ(result.value(), i * 100);
+    }
+}
+
+template <typename K>
+void check_key_search() {
+    std::mt19937_64 rng(42);
+    for (std::size_t n : {0, 1, 2, 5, 31, 32, 33, 100, 4096, 10007}) {
+        std::vector<K> keys;
+        keys.push_back(std::numeric_limits<K>::min());
+        keys.push_back(std::numeric_limits<K>::max());
+        keys.push_back(0);
+        while (keys.size() < n + 3) {
+            keys.push_back(static_cast<K>(rng()));
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        keys.resize(std::min(keys.size(), n));
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<K> probes = keys;
+        for (int i = 0; i < 1000; ++i) {
+            probes.push_back(static_cast<K>(rng()));
+        }
+        probes.push_back(std::numeric_limits<K>::min());
+        probes.push_back(std::numeric_limits<K>::max());
+        for (const K &key : probes) {
+            std::size_t expected = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            ASSERT_EQ(KeySearch<K>::lower_bound(keys.data(), keys.size(), key), expected);
+        }
+    }
+}
+
+TEST(SSTTest, IntegerKeySearch) {
+    check_key_search<int32_t>();
+    check_key_search<uint32_t>();
+    check_key_search<int64_t>();
+    check_key_search<uint64_t>();
+    check_key_search<int16_t>();
+}
+
+TEST(SSTTest, LearnedIndex) {
+    ConfigGuard layout_guard(CONFIG::sst_search_layout, SearchLayout::Learned);
+
+    // 近似均匀的时间戳
+    std::mt19937_64 rng(7);
+    MemTable<int64_t, int> mem_table(100000);
+    int64_t ts = 1700000000000;
+    for (int i = 0; i < 100000; ++i) {
+        ts += 1 + rng() % 20;
+        mem_table.set(ts, i);
+    }
+    SST<int64_t, int> sst(mem_table);
+    // 每个分区一个模型, 只覆盖该分区的key
+    ASSERT_GT(sst.get_partition_count(), 1u);
+    std::size_t index_bytes = 0;
+    for (std::size_t partition = 0; partition < sst.get_partition_count(); ++partition) {
+        const auto &index = sst.get_learned_index(partition);
+        ASSERT_FALSE(index.empty());
+        EXPECT_LE(index.get_max_error(), CONFIG::LEARNED_INDEX_EPSILON + 1);
+        index_bytes += index.memory_usage();
+    }
+    EXPECT_LT(index_bytes, sst.size() * sizeof(int64_t) / 10);
+
+    std::vector<int64_t> keys;
+    for (const auto &[key, value] : mem_table.get_table()) {
+        keys.push_back(key);
+    }
+    for (int64_t key = keys.front() - 5; key <= keys.back() + 5; key += 1 + rng() % 7) {
+        std::size_t expected = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        ASSERT_EQ(sst.seek(key), expected) << "key=" << key;
+    }
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(sst.get(keys[i]), static_cast<int>(i));
+    }
+}
+
+TEST(SSTTest, PartitionedIndexAndFilter) {
+    ConfigGuard partition_guard(CONFIG::SST_PARTITION_ENTRY, 128);
+
+    MemTable<int, int> mem_table(10000);
+    for (int i = 0; i < 10000; ++i) {
+        mem_table.set(i * 2, i);
+    }
+    SST<int, int> sst(mem_table);
+    EXPECT_EQ(sst.get_partition_count(), (10000u + 127) / 128);
+
+    for (int key = -3; key <= 20003; ++key) {
+        std::size_t expected = key < 0 ? 0 : std::min((key + 1) / 2, 10000);
+        ASSERT_EQ(sst.seek(key), expected) << "key=" << key;
+    }
+    std::size_t false_positives = 0;
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_EQ(sst.get(i * 2), i);
+        ASSERT_TRUE(sst.may_contain(i * 2));
+        ASSERT_FALSE(sst.get(i * 2 + 1).has_value());
+        false_positives += sst.may_contain(i * 2 + 1);
+    }
+    // 10 bits/key的理论假阳性率约为1%
+    EXPECT_LT(false_positives, 300u);
+}
+
+TEST(SSTTest, StaticFilters) {
+    std::vector<std::uint64_t> hashes;
+    for (int i = 0; i < 100000; ++i) {
+        hashes.push_back(key_hash(i));
+    }
+    auto false_positives = [&](const Filter &filter) {
+        std::size_t count = 0;
+        for (int i = 0; i < 100000; ++i) {
+            count += filter.may_contain(key_hash(i + 100000));
+        }
+        return count;
+    };
+    // 假阳性不多于max_false_positives的最小的Bloom filter
+    auto bloom_with = [&](std::size_t max_false_positives) {
+        for (std::size_t bits_per_key = 1;; ++bits_per_key) {
+            Filter bloom(FilterType::Bloom, hashes, bits_per_key);
+            if (false_positives(bloom) <= max_false_positives) {
+                return bloom;
+            }
+        }
+    };
+
+    Filter xor_filter(FilterType::Xor, hashes, 0);
+    Filter ribbon_filter(FilterType::Ribbon, hashes, 0);
+    EXPECT_EQ(ribbon_filter.type(), FilterType::Ribbon);
+    for (int i = 0; i < 100000; ++i) {
+        ASSERT_TRUE(xor_filter.may_contain(key_hash(i)));
+        ASSERT_TRUE(ribbon_filter.may_contain(key_hash(i)));
+    }
+    // 都是8位指纹, 理论假阳性率1/256
+    std::size_t xor_fp = false_positives(xor_filter);
+    std::size_t ribbon_fp = false_positives(ribbon_filter);
+    EXPECT_LT(xor_fp, 600u);
+    EXPECT_LT(ribbon_fp, 600u);
+
+    // 与假阳性率相同的Bloom filter相比: xor filter约9.84 bits/key, 节省约15%; ribbon filter约8.3 bits/key, 节省约30%
+    EXPECT_LT(xor_filter.memory_usage() * 8, hashes.size() * 10);
+    EXPECT_LT(xor_filter.memory_usage(), bloom_with(xor_fp).memory_usage() * 0.9);
+    EXPECT_LT(ribbon_filter.memory_usage() * 8, hashes.size() * 8.5);
+    EXPECT_LT(ribbon_filter.memory_usage(), bloom_with(ribbon_fp).memory_usage() * 0.72);
+
+    // 很少的key和空的filter
+    for (std::size_t n : {0, 1, 100}) {
+        std::vector<std::uint64_t> few(hashes.begin(), hashes.begin() + n);
+        Filter filter(FilterType::Ribbon, few, 0);
+        for (std::uint64_t hash : few) {
+            ASSERT_TRUE(filter.may_contain(hash));
+        }
+    }
+}
+
+TEST(SSTTest, Subcompactions) {
+    ConfigGuard subcompactions_guard(CONFIG::NUM_SUBCOMPACTIONS);
+    ConfigGuard min_entries_guard(CONFIG::SUBCOMPACTION_MIN_ENTRIES);
+
+    // 从旧到新的互相重叠的SST
+    auto make_inputs = []() {
+        std::list<SST<int, int>> ssts;
+        std::mt19937 rng(29);
+        for (int i = 0; i < 8; ++i) {
+            MemTable<int, int> memtable(5000);
+            while (!memtable.is_full()) {
+                memtable.set(static_cast<int>(rng() % 20000), i);
+            }
+            ssts.emplace_back(memtable, memtable.size());
+        }
+        return ssts;
+    };
+    auto entries = [](const std::list<SST<int, int>> &ssts) {
+        std::vector<std::pair<int, std::optional<int>>> result;
+        for (const auto &sst : ssts) {
+            for (std::size_t i = 0; i < sst.size(); ++i) {
+                result.emplace_back(sst.key_at(i), sst.value_at(i));
+            }
+        }
+        return result;
+    };
+
+    CONFIG::NUM_SUBCOMPACTIONS = 1;
+    auto expected = entries(SST<int, int>::merge_split(make_inputs(), 64));
+    std::list<SST<int, int>> expected_merged;
+    expected_merged.push_back(SST<int, int>::merge(make_inputs()));
+
+    CONFIG::NUM_SUBCOMPACTIONS = 4;
+    CONFIG::SUBCOMPACTION_MIN_ENTRIES = 1000;
+    // 确实拆分为4个区间
+    auto inputs = make_inputs();
+    std::size_t total = 0;
+    for (const auto &sst : inputs) {
+        total += sst.size();
+    }
+    auto boundaries = SST<int, int>::sample_boundaries(inputs, total, Options());
+    ASSERT_EQ(boundaries.size(), 3u);
+    EXPECT_TRUE(std::is_sorted(boundaries.begin(), boundaries.end()));
+    EXPECT_TRUE((SST<int, int>::sample_boundaries(inputs, CONFIG::SUBCOMPACTION_MIN_ENTRIES - 1, Options()).empty()));
+    auto outputs = SST<int, int>::merge_split(make_inputs(), 64);
+    EXPECT_EQ(entries(outputs), expected);
+    for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+        EXPECT_LE(it->size(), 64u);
+        if (std::next(it) != outputs.end()) {
+            EXPECT_LT(it->get_key_range().second, std::next(it)->get_key_range().first);
+        }
+    }
+    std::list<SST<int, int>> merged;
+    merged.push_back(SST<int, int>::merge(make_inputs()));
+    EXPECT_EQ(entries(merged), entries(expected_merged));
+
+    // compaction中使用子compaction: 一个文件与下层重叠的几个文件合并时就拆分
+    ConfigGuard type_guard(CONFIG::compact_type, CompactType::Leveling);
+    CONFIG::SUBCOMPACTION_MIN_ENTRIES = 4 * CONFIG::NUM_FILE_ENTRY;
+    LSM<int, int> lsm;
+    std::map<int, int> expected_values;
+    std::mt19937 rng(31);
+    for (int i = 0; i < 50000; ++i) {
+        int key = static_cast<int>(rng() % 20000);
+        lsm.set(key, i);
+        expected_values[key] = i;
+    }
+    for (const auto &[key, value] : expected_values) {
+        ASSERT_EQ(lsm.get(key), value) << "key=" << key;
+    }
+    EXPECT_GT(lsm.get_levels().get_stats().split_compactions, 0u);
+}
+
+TEST(LSMTest, PerLevelFilterType) {
+    ConfigGuard types_guard(CONFIG::level_filter_types);
+    CONFIG::level_filter_types = {FilterType::Bloom, FilterType::Xor, FilterType::Ribbon};
+
+    LSM<int, int> lsm;
+    for (int i = 1; i <= 1000; ++i) {
+        lsm.set(i, i);
+    }
+    for (int i = 1; i <= 1000; ++i) {
+        ASSERT_EQ(lsm.get(i), i);
+    }
+    ASSERT_FALSE(lsm.get(1001).has_value());
+
+    const auto &levels = lsm.get_levels();
+    EXPECT_EQ(levels[0].get_filter_type(), FilterType::Bloom);
+    EXPECT_EQ(levels[1].get_filter_type(), FilterType::Xor);
+    EXPECT_EQ(levels[2].get_filter_type(), FilterType::Ribbon);
+    EXPECT_EQ(levels[3].get_filter_type(), CONFIG::filter_type);
+    EXPECT_GT(levels[1].get_stats().compactions, 0u);
+    EXPECT_GT(levels[1].get_stats().filter_build_time.count(), 0);
+    EXPECT_GE(levels.get_stats().filter_build_time, levels[1].get_stats().filter_build_time);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     INIT_LOGGER();